@@ -0,0 +1,381 @@
+/*
+ * Shared pieces for the Game of Life drivers (sequential, omp, pthread, mpi).
+ *
+ * Each driver still owns its world arrays, init() and output; the code
+ * here is the grid layout, the alternative update engines and the command
+ * line options that select them.
+ */
+
+#ifndef LIFE_H
+#define LIFE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Update engines, selected with --engine=<name> */
+typedef enum {
+    ENGINE_BYTE = 0,    /* one cell per char, neighborcount() */
+    ENGINE_BITPACK,     /* 64 cells per uint64_t, bitwise adders */
+    ENGINE_SIMD,        /* one cell per char, vector row kernel */
+    ENGINE_TILED,       /* vector row kernel, several generations per tile */
+    ENGINE_HASHLIFE,    /* memoized quadtree */
+    ENGINE_SPARSE,      /* live cells only, as sorted coordinate runs */
+    ENGINE_LUT,         /* one cell per char, 4x4 -> 2x2 lookup table */
+    ENGINE_BOX          /* one cell per char, separable 3x3 box sum */
+} Engine;
+
+/* Set of engines a driver implements, for life_check_engine() */
+#define ENGINE_BIT(e) (1u << (e))
+
+/* Most generations one tiled pass may advance */
+#define TILED_MAX_STEPS 64
+
+/* Deepest MPI ghost zone, so most generations between exchanges */
+#define GHOST_MAX_DEPTH 64
+
+/* Where the grids get their memory. Grids of 2 MiB or more are mapped on
+   2 MiB boundaries and, unless small, asked for huge pages: transparent
+   ones through madvise(), or hugetlb ones, falling back to transparent
+   ones when none are reserved. Set from --pages=, default thp. */
+typedef enum { PAGES_SMALL, PAGES_THP, PAGES_HUGETLB } PageMode;
+extern PageMode life_pages;
+
+typedef struct {
+    Engine engine;
+    int engine_set;     /* --engine= was given, so the profile is not used */
+    const char *isa;    /* --isa=: widest SIMD kernel to use, NULL for any */
+    int tile_w, tile_h; /* --tile=: tiled-engine tile size, in cells */
+    int tile_set;       /* --tile= was given, so the profile's is not used */
+    int tsteps;         /* --tsteps=: generations per tiled pass */
+    int hl_step;        /* --hl-step=: hashlife jumps 2^hl_step generations */
+    int hl_mem;         /* --hl-mem=: hashlife node cache limit, in MB */
+    int active;         /* --active=: active-tile edge, 0 to compute every cell */
+    int task_us;        /* --task-us=: pthread target task time, 0 for fixed chunks */
+    int pin;            /* --pin: pin omp/pthread threads to CPUs */
+    int dataflow;       /* --dataflow: omp generations as dependent tasks */
+    int omp_tune;       /* --omp-tune[=FILE]: time omp loop setups, keep the best */
+    const char *omp_profile;    /* FILE above, NULL for none */
+    int tune;           /* --tune: write the machine profile and exit */
+    const char *profile;        /* --profile=: machine profile file */
+    PageMode pages;     /* --pages=, also copied to life_pages */
+    int ghost;          /* --ghost=: MPI ghost cell depth */
+    int threads;        /* --threads=: MPI threads per rank, 0 for the default */
+} LifeOptions;
+
+/* Default machine profile, in the working directory */
+#define LIFE_PROFILE "life_profile.txt"
+
+/* Set to keep the option and kernel setup code from printing its error
+   messages, e.g. on every MPI rank but one */
+extern int life_quiet;
+
+/* Pull the --options out of argv so the positional w_X w_Y handling stays
+   as it was. Returns 0 on success, -1 (after printing why) on bad input. */
+int life_parse_options(int *argc, char *argv[], LifeOptions *opts);
+const char *engine_name(Engine engine);
+
+/* Returns -1 (after printing why) unless opts->engine is in supported,
+   a set of ENGINE_BIT()s, and the other options go with it */
+int life_check_engine(const LifeOptions *opts, unsigned supported);
+
+/* --tune: time the grid engines on a synthetic world and write the machine
+   profile to file. Returns 0, or -1 after printing why. */
+int life_tune(const char *file);
+
+/* Unless --engine= was given, switch to the engine in supported that the
+   machine profile (if there is one) found fastest, with its tile size */
+void life_apply_profile(LifeOptions *opts, unsigned supported);
+
+/* The option list for a driver's usage message */
+void life_print_options(void);
+
+/*
+ * Bit-packed world. Bit i of word k in a row is cell x = 64 * k + i.
+ * Every row has a zero word on each side and there is a zero row above
+ * and below the world, so the step never needs a boundary test.
+ */
+typedef struct {
+    int w_X, w_Y;
+    size_t words;       /* words holding cells in one row */
+    size_t stride;      /* words per row, including the two border words */
+    uint64_t *cur;
+    uint64_t *next;
+} BitWorld;
+
+int bitworld_alloc(BitWorld *bw, int X, int Y);
+void bitworld_free(BitWorld *bw);
+
+/* Convert from/to a char grid where cell (x, y) is cells[y * row_stride + x] */
+void bitworld_load(BitWorld *bw, const char *cells, size_t row_stride);
+void bitworld_store(const BitWorld *bw, char *cells, size_t row_stride);
+
+/* Compute rows [y0, y1) of the next generation, return their population */
+long bitworld_step(BitWorld *bw, int y0, int y1);
+
+/* Make the generation computed by bitworld_step() the current one */
+void bitworld_swap(BitWorld *bw);
+
+/*
+ * Char grids carry a permanently zero one-cell border (the halo), so every
+ * cell has eight neighbors to add and nothing needs a boundary test.
+ * Grids are sized at runtime; rows are stride bytes apart (a multiple of
+ * 64) and all offsets are computed in size_t, so worlds can go well past
+ * 2^31 cells.
+ */
+#define HALO 1
+
+typedef struct {
+    char *cells;        /* (height + 2 * HALO) rows of stride bytes */
+    size_t stride;      /* bytes per row, border included */
+    int width, height;
+    size_t map_bytes;   /* length of the huge page mapping, 0 if malloc'd */
+    PageMode page_mode; /* pages asked for, which it may not have got */
+} Grid;
+
+/* Allocate a zeroed width x height grid. Returns 0, or -1 if out of memory. */
+int grid_alloc(Grid *g, int width, int height);
+void grid_free(Grid *g);
+
+/* Same, but nothing is written: the caller zeroes the rows, border rows
+   included, with grid_zero_rows(). Threads that zero the rows they will
+   compute touch those pages first, which puts them on their NUMA node. */
+int grid_alloc_untouched(Grid *g, int width, int height);
+void grid_zero_rows(Grid *g, int y0, int y1);   /* rows y0 to y1 - 1 */
+
+/* Columns [x0, x1) of g as a grid of their own, sharing its cells, so band
+   kernels can update part of the width. Do not free it. */
+Grid grid_columns(const Grid *g, int x0, int x1);
+
+/* g less margin cells on every side, sharing its cells, so the view can be
+   indexed margin + 1 cells past each of its edges. Do not free it. */
+Grid grid_inset(const Grid *g, int margin);
+
+/* Write what page size the kernel gave g, once it has been touched, into
+   buf. Returns -1, writing nothing, for grids under a huge page. */
+int grid_describe_pages(const Grid *g, char *buf, size_t len);
+
+/* Pin the calling thread to the index-th CPU (wrapping around) of those the
+   process may run on. Returns that CPU, or -1 if it could not be pinned. */
+int life_pin_thread(int index);
+
+/* CPU the calling thread is on, -1 if unknown */
+int life_current_cpu(void);
+
+/* Print one line on where the n threads run, cpu[t] being thread t's CPU
+   (-1 if unknown): how many CPUs they share, and with detail each one */
+void life_print_placement(const char *what, const int *cpu, int n, int pinned, int detail);
+
+/* CELL() takes world coordinates, where row -1 / height and column -1 /
+   width are the border; GRID_ROW() is the address of cell 0 of a row. */
+#define GRID_ROW(g, y) ((g)->cells + ((size_t)((y) + HALO)) * (g)->stride + HALO)
+#define CELL(g, y, x) (GRID_ROW(g, y)[x])
+
+/*
+ * Row kernel for char grids: computes out[0..n) from the rows above, at and
+ * below it and returns the population of out. up, mid and down must be
+ * readable from index -1 to n.
+ */
+typedef long (*RowKernel)(char *out, const char *up, const char *mid,
+                          const char *down, int n);
+
+/* Widest vector kernel this CPU runs, set by simd_init() */
+extern RowKernel simd_row;
+
+/* The same rule a cell at a time, as the byte engine does it */
+long scalar_row(char *out, const char *up, const char *mid, const char *down, int n);
+
+/*
+ * Band kernel for char grids: computes rows [y0, y1) of dst from src (rows
+ * y0 - 1 to y1 must be there, border or ghost rows included) and returns
+ * their population.
+ */
+typedef long (*BandKernel)(Grid *dst, const Grid *src, int y0, int y1);
+
+/* simd_row() or scalar_row() over each row of the band */
+long simd_band(Grid *dst, const Grid *src, int y0, int y1);
+long scalar_band(Grid *dst, const Grid *src, int y0, int y1);
+
+/* Lookup table: a 2x2 block per read, for pairs of rows. lut_init() builds
+   the table and has to be called first. */
+void lut_init(void);
+long lut_band(Grid *dst, const Grid *src, int y0, int y1);
+
+/* Box sum: column sums of the three rows, then a three-column window over
+   them less the cell itself. Needs no setup. */
+long box_row(char *out, const char *up, const char *mid, const char *down, int n);
+long box_band(Grid *dst, const Grid *src, int y0, int y1);
+
+/* Pick the kernel, optionally no wider than max_isa (avx512, avx2, sse2,
+   scalar). Returns -1 if that cap is unknown. */
+int simd_init(const char *max_isa);
+const char *simd_isa(void);
+
+/*
+ * Temporal tiling: advance src k generations (1 <= k <= TILED_MAX_STEPS)
+ * into dst, tile_w x tile_h cells at a time, each tile with a k-cell margin
+ * so it can run all k generations while it is in cache. counts[g] gets the
+ * population after generation g + 1. Uses simd_row, so call simd_init()
+ * first. dst must not be src. Returns 0, or -1 if out of memory.
+ */
+int tiled_step(Grid *dst, const Grid *src, int k, int tile_w, int tile_h,
+               long *counts);
+
+/*
+ * Active tiles (--active=N): the char grid is cut into N x N tiles and a
+ * tile is only recomputed when it or one of its eight neighbors changed in
+ * the previous generation; the others keep their cells and population.
+ */
+typedef struct {
+    int tile;
+    int tiles_x, tiles_y;
+    int width, height;
+    unsigned char *changed;     /* per tile, in the generation being computed */
+    unsigned char *was_changed; /* per tile, in the one before */
+    long *pop;                  /* per tile population */
+} ActiveTiles;
+
+int active_alloc(ActiveTiles *at, int width, int height, int tile);
+void active_free(ActiveTiles *at);
+
+/* Compute rows [y0, y1) of the next generation of src into dst with kernel,
+   skipping tiles that cannot have changed; y0 must be a multiple of the
+   tile size, and so must y1 unless it is the height. Returns the rows'
+   population and adds the number of tiles computed to *active. Different
+   threads may run disjoint row ranges at once. */
+long active_step(ActiveTiles *at, Grid *dst, const Grid *src, RowKernel kernel,
+                 int y0, int y1, long *active);
+
+/* Call once the whole generation is done, before the next active_step() */
+void active_swap(ActiveTiles *at);
+long active_total(const ActiveTiles *at);
+
+/*
+ * Hashlife. The world is held inside the module; hashlife_load() copies it
+ * in from a grid and hashlife_store() back out. mem_limit caps the node
+ * cache: once it is passed, unreachable nodes and their memos are freed
+ * before the next step (so a single step can still go over).
+ */
+int hashlife_load(const Grid *g, size_t mem_limit);    /* 0, or -1: too big */
+
+/* Advance 2^j generations (0 <= j <= hashlife_max_step()), return the
+   population */
+long hashlife_step(int j);
+int hashlife_max_step(void);
+
+/* Remember the current world, and go back to it */
+void hashlife_checkpoint(void);
+void hashlife_rollback(void);
+
+void hashlife_store(Grid *g);
+size_t hashlife_nodes(void);
+void hashlife_free(void);
+
+/*
+ * Sparse world: the live cells only, as sorted keys (x << 32) | y. There
+ * is no grid at all, so the size of the world is limited by the number of
+ * live cells rather than by w_X * w_Y.
+ */
+typedef struct {
+    int w_X, w_Y;
+    uint64_t *live;             /* live cell keys */
+    size_t count, live_cap;
+    int sorted;                 /* live is sorted and has no repeats */
+    uint64_t *next;             /* next generation, during a step */
+    size_t next_count, next_cap;
+} SparseWorld;
+
+int sparse_alloc(SparseWorld *sw, int X, int Y);
+void sparse_free(SparseWorld *sw);
+
+/* Make a cell alive; adding one twice is harmless. 0, or -1 if out of
+   memory. */
+int sparse_add(SparseWorld *sw, int x, int y);
+
+/* One generation; returns the population, or -1 if out of memory */
+long sparse_step(SparseWorld *sw);
+long sparse_count(SparseWorld *sw);
+int sparse_get(SparseWorld *sw, int x, int y);
+
+/* Write the world in the final_world000.txt layout */
+int sparse_write(SparseWorld *sw, FILE *fd);
+
+/*
+ * 2D block decomposition for the MPI drivers (life_cart.c, linked into
+ * those only; include mpi.h before this header). Ranks form a dims[0] x
+ * dims[1] Cartesian grid, each holding local_w_Y rows by local_w_X columns
+ * of the world from (y0, x0), with depth ghost cells around them: cells
+ * -depth to local_w_X + depth - 1 of a grid from grid_inset(), or the grid
+ * border when depth is 1.
+ */
+#ifdef MPI_VERSION
+typedef struct {
+    MPI_Comm comm;              /* Cartesian communicator of all the ranks */
+    int rank, size;             /* in comm, which may renumber them */
+    int dims[2], coords[2];     /* [0] rows of ranks, [1] columns */
+    int w_X, w_Y;               /* the whole world */
+    int y0, x0;                 /* this rank's block */
+    int local_w_Y, local_w_X;
+    int nbr[8];                 /* ranks around, row by row, MPI_PROC_NULL
+                                   past the edges of the world */
+    int depth;                  /* ghost cells on each side */
+    MPI_Datatype halo[8];       /* cells sent to nbr[d], made on first use */
+    int threads;                /* OpenMP threads updating the block, 1 from
+                                   cart_init(), see cart_threads() */
+} Cart;
+
+/* Split a w_X x w_Y world over all the ranks, with depth ghost cells (less
+   if a block is smaller than that) */
+void cart_init(Cart *c, int w_X, int w_Y, int depth);
+void cart_free(Cart *c);
+
+/* Rows r[0] to r[1] - 1 by columns r[2] to r[3] - 1: the block with margin
+   cells more on the sides that have a neighbor */
+void cart_region(const Cart *c, int margin, int r[4]);
+
+/* Make world cell (y, x) of g alive if it is in this rank's block */
+void cart_set(const Cart *c, Grid *g, int y, int x);
+
+/* Post the halo exchange of g, depth cells deep, with the eight neighbors
+   and return how many of requests (room for 16) it used. Until they
+   complete only the cells with no ghost neighbor may be read, and none of
+   g written. */
+int cart_start_exchange(Cart *c, Grid *g, MPI_Request *requests);
+
+/* The same exchange as persistent requests, set up once per grid: each
+   MPI_Startall() of them runs it again, the buffers, peers and tags
+   fixed. MPI_Request_free() them before cart_free(). */
+int cart_exchange_init(Cart *c, Grid *g, MPI_Request *requests);
+
+/* One generation of the block from src into dst, and of margin ghost cells
+   more on the sides with a neighbor, on c->threads threads; band is the
+   engine's kernel, NULL for the byte engine. The interior, which reads no
+   ghost cell, goes first, while the req_count requests (if any) complete.
+   Returns the population of the block alone. */
+long cart_generation(const Cart *c, BandKernel band, Grid *dst, const Grid *src, int margin,
+                     MPI_Request *requests, int req_count);
+
+/* Run n generations (n <= c->depth) from start, one of views, whose ghost
+   cells the req_count requests exchange, through the other two views and
+   return the one holding the last; start is left as it was. counts[g] gets
+   the population of the block after generation g + 1. */
+Grid *cart_run(const Cart *c, BandKernel band, Grid views[3], Grid *start, int n,
+               MPI_Request *requests, int req_count, long *counts);
+
+/* The stop rules: 200 generations at most, while the population stays
+   within 50 times the initial one either way */
+int cart_keep_going(int iter, long count, long init_count);
+
+/* Collect the blocks of g on rank 0, which gets the w_Y x w_X world, row
+   by row (free() it); NULL on the other ranks */
+char *cart_gather(const Cart *c, const Grid *g);
+
+/* OpenMP threads each rank updates its block with: requested (from
+   --threads=) if not 0, else OMP_NUM_THREADS if set, else one, as there may
+   already be a rank per core. One unless provided, the thread level
+   MPI_Init_thread() gave, is at least MPI_THREAD_FUNNELED: only the master
+   thread calls MPI, outside the parallel regions. */
+int cart_threads(int requested, int provided);
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Active tiles: skip the parts of the world that did not change.
+ *
+ * The grid is cut into tile x tile squares. A cell's next state depends
+ * only on its 3x3 neighborhood, so if neither a tile nor any of its eight
+ * neighbors changed in the last generation, the tile will not change in
+ * this one either and is not recomputed. Its population is carried over.
+ *
+ * Skipped tiles are never written, so this relies on the drivers' double
+ * buffer: the grid being written still holds the generation before the
+ * current one, which for a tile that did not change is the same as the
+ * one being computed. The first generation computes every tile.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "life.h"
+
+int active_alloc(ActiveTiles *at, int width, int height, int tile)
+{
+    size_t n;
+
+    at->tile = tile;
+    at->tiles_x = (width + tile - 1) / tile;
+    at->tiles_y = (height + tile - 1) / tile;
+    at->width = width;
+    at->height = height;
+
+    n = (size_t)at->tiles_x * at->tiles_y;
+    at->changed = (unsigned char *)calloc(n, 1);
+    at->was_changed = (unsigned char *)malloc(n);
+    at->pop = (long *)calloc(n, sizeof(long));
+    if (!at->changed || !at->was_changed || !at->pop) {
+        active_free(at);
+        return -1;
+    }
+
+    /* Nothing has been computed yet, so every tile counts as changed */
+    memset(at->was_changed, 1, n);
+    return 0;
+}
+
+void active_free(ActiveTiles *at)
+{
+    free(at->changed);
+    free(at->was_changed);
+    free(at->pop);
+    at->changed = at->was_changed = NULL;
+    at->pop = NULL;
+}
+
+/* Whether tile (tx, ty) or one of its neighbors changed last generation */
+static int tile_is_active(const ActiveTiles *at, int tx, int ty)
+{
+    for (int y = ty - 1; y <= ty + 1; y++) {
+        if (y < 0 || y >= at->tiles_y) continue;
+        for (int x = tx - 1; x <= tx + 1; x++) {
+            if (x < 0 || x >= at->tiles_x) continue;
+            if (at->was_changed[(size_t)y * at->tiles_x + x]) return 1;
+        }
+    }
+    return 0;
+}
+
+long active_step(ActiveTiles *at, Grid *dst, const Grid *src, RowKernel kernel,
+                 int y0, int y1, long *active)
+{
+    long count = 0;
+
+    for (int ty = y0 / at->tile; ty * at->tile < y1; ty++) {
+        int ya = ty * at->tile;
+        int yb = ya + at->tile < at->height ? ya + at->tile : at->height;
+
+        for (int tx = 0; tx < at->tiles_x; tx++) {
+            size_t t = (size_t)ty * at->tiles_x + tx;
+            int x0 = tx * at->tile;
+            int n = x0 + at->tile < at->width ? at->tile : at->width - x0;
+            int diff = 0;
+            long pop = 0;
+
+            if (!tile_is_active(at, tx, ty)) {
+                at->changed[t] = 0;
+                count += at->pop[t];
+                continue;
+            }
+
+            (*active)++;
+            for (int y = ya; y < yb; y++) {
+                char *out = GRID_ROW(dst, y) + x0;
+                const char *mid = GRID_ROW(src, y) + x0;
+
+                pop += kernel(out, GRID_ROW(src, y - 1) + x0, mid,
+                              GRID_ROW(src, y + 1) + x0, n);
+                diff |= memcmp(out, mid, n) != 0;
+            }
+            at->changed[t] = (unsigned char)diff;
+            at->pop[t] = pop;
+            count += pop;
+        }
+    }
+    return count;
+}
+
+void active_swap(ActiveTiles *at)
+{
+    unsigned char *t = at->was_changed;
+    at->was_changed = at->changed;
+    at->changed = t;
+}
+
+long active_total(const ActiveTiles *at)
+{
+    return (long)at->tiles_x * at->tiles_y;
+}
@@ -0,0 +1,70 @@
+/*
+ * Thread placement: pinning worker threads to CPUs and reporting where
+ * they run. Linux only; elsewhere nothing is pinned and the CPU is unknown.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include "life.h"
+
+int life_pin_thread(int index)
+{
+#ifdef __linux__
+    cpu_set_t allowed, one;
+    int n, cpu;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+    n = CPU_COUNT(&allowed);
+    if (n == 0) return -1;
+    index %= n;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || index-- > 0) continue;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(one), &one) != 0) return -1;
+        return cpu;
+    }
+    return -1;
+#else
+    (void)index;
+    return -1;
+#endif
+}
+
+int life_current_cpu(void)
+{
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+void life_print_placement(const char *what, const int *cpu, int n, int pinned, int detail)
+{
+    int cpus = 0, unknown = 0;
+
+    for (int t = 0; t < n; t++) {
+        int seen = 0;
+
+        if (cpu[t] < 0) {
+            unknown++;
+            continue;
+        }
+        for (int u = 0; u < t && !seen; u++) seen = cpu[u] == cpu[t];
+        cpus += !seen;
+    }
+
+    printf("%s placement: %d threads on %d CPU%s, %s", what, n, cpus, cpus == 1 ? "" : "s",
+           pinned ? "pinned" : "not pinned");
+    if (unknown) printf(", %d on an unknown CPU", unknown);
+    if (detail) {
+        printf(":");
+        for (int t = 0; t < n; t++) printf(" %d->cpu%d", t, cpu[t]);
+    }
+    printf("\n");
+}
@@ -0,0 +1,131 @@
+/*
+ * Bit-packed update engine: 64 cells per uint64_t.
+ *
+ * The eight neighbors of every bit are lined up as shifted copies of the
+ * three rows around it and summed with full-adder logic, so one pass over
+ * a word does the neighborcount() and the rule for 64 cells at once.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "life.h"
+
+#define ROW(bw, buf, y) ((buf) + ((size_t)(y) + 1) * (bw)->stride + 1)
+
+int bitworld_alloc(BitWorld *bw, int X, int Y)
+{
+    size_t total;
+
+    bw->w_X = X;
+    bw->w_Y = Y;
+    bw->words = ((size_t)X + 63) / 64;
+    bw->stride = bw->words + 2;
+
+    total = ((size_t)Y + 2) * bw->stride;
+    bw->cur = (uint64_t *)calloc(total, sizeof(uint64_t));
+    bw->next = (uint64_t *)calloc(total, sizeof(uint64_t));
+    if (!bw->cur || !bw->next) {
+        bitworld_free(bw);
+        return -1;
+    }
+    return 0;
+}
+
+void bitworld_free(BitWorld *bw)
+{
+    free(bw->cur);
+    free(bw->next);
+    bw->cur = bw->next = NULL;
+}
+
+void bitworld_load(BitWorld *bw, const char *cells, size_t row_stride)
+{
+    for (int y = 0; y < bw->w_Y; y++) {
+        uint64_t *row = ROW(bw, bw->cur, y);
+        const char *src = cells + (size_t)y * row_stride;
+
+        memset(row, 0, bw->words * sizeof(uint64_t));
+        for (int x = 0; x < bw->w_X; x++) {
+            if (src[x] == 1) row[x >> 6] |= (uint64_t)1 << (x & 63);
+        }
+    }
+}
+
+void bitworld_store(const BitWorld *bw, char *cells, size_t row_stride)
+{
+    for (int y = 0; y < bw->w_Y; y++) {
+        const uint64_t *row = ROW(bw, bw->cur, y);
+        char *dst = cells + (size_t)y * row_stride;
+
+        for (int x = 0; x < bw->w_X; x++) {
+            dst[x] = (char)((row[x >> 6] >> (x & 63)) & 1);
+        }
+    }
+}
+
+/* Next state of the 64 cells in mid, given each row shifted west and east */
+static inline uint64_t life_word(uint64_t up_w, uint64_t up, uint64_t up_e,
+                                 uint64_t mid_w, uint64_t mid, uint64_t mid_e,
+                                 uint64_t dn_w, uint64_t dn, uint64_t dn_e)
+{
+    /* Rows above and below: 3-input adders, own row: 2-input adder */
+    uint64_t s_up = up_w ^ up ^ up_e;
+    uint64_t c_up = (up_w & up) | (up_e & (up_w ^ up));
+    uint64_t s_dn = dn_w ^ dn ^ dn_e;
+    uint64_t c_dn = (dn_w & dn) | (dn_e & (dn_w ^ dn));
+    uint64_t s_mid = mid_w ^ mid_e;
+    uint64_t c_mid = mid_w & mid_e;
+
+    /* Ones digit of the count and its carry into the twos */
+    uint64_t ones = s_up ^ s_mid ^ s_dn;
+    uint64_t carry = (s_up & s_mid) | (s_dn & (s_up ^ s_mid));
+
+    /* The twos digit is c_up + c_mid + c_dn + carry; 2 or 3 neighbors
+       means exactly one of those four is set */
+    uint64_t a = c_up ^ c_mid, a2 = c_up & c_mid;
+    uint64_t b = c_dn ^ carry, b2 = c_dn & carry;
+    uint64_t twos_is_one = (a ^ b) & ~(a2 | b2);
+
+    /* 3 neighbors: alive, 2 neighbors: unchanged, anything else: dead */
+    return twos_is_one & (ones | mid);
+}
+
+long bitworld_step(BitWorld *bw, int y0, int y1)
+{
+    size_t words = bw->words;
+    uint64_t last_mask = ~(uint64_t)0;
+    long count = 0;
+
+    if (bw->w_X % 64) last_mask = ((uint64_t)1 << (bw->w_X % 64)) - 1;
+
+    for (int y = y0; y < y1; y++) {
+        const uint64_t *up = ROW(bw, bw->cur, y - 1);
+        const uint64_t *mid = ROW(bw, bw->cur, y);
+        const uint64_t *dn = ROW(bw, bw->cur, y + 1);
+        uint64_t *out = ROW(bw, bw->next, y);
+
+        for (size_t k = 0; k < words; k++) {
+            /* West neighbor of bit i is bit i-1, east is bit i+1; the
+               border words supply the bits that cross a word edge */
+            uint64_t v = life_word((up[k] << 1) | (up[k - 1] >> 63), up[k],
+                                   (up[k] >> 1) | (up[k + 1] << 63),
+                                   (mid[k] << 1) | (mid[k - 1] >> 63), mid[k],
+                                   (mid[k] >> 1) | (mid[k + 1] << 63),
+                                   (dn[k] << 1) | (dn[k - 1] >> 63), dn[k],
+                                   (dn[k] >> 1) | (dn[k + 1] << 63));
+            if (k == words - 1) v &= last_mask;
+            out[k] = v;
+            count += __builtin_popcountll(v);
+        }
+    }
+
+    return count;
+}
+
+void bitworld_swap(BitWorld *bw)
+{
+    uint64_t *t = bw->cur;
+    bw->cur = bw->next;
+    bw->next = t;
+}
@@ -0,0 +1,50 @@
+/*
+ * Box-sum engine: the 3x3 neighborhood sum as a separable filter.
+ *
+ * For a block of columns, the three rows are first added into a buffer of
+ * column sums; a sliding window of three of those, less the cell itself,
+ * is its neighbor count. That is two adds and a subtract per cell over
+ * contiguous bytes instead of eight loads, and both loops have no branches,
+ * so the compiler vectorizes them. The buffer is on the stack, one block
+ * at a time, so it stays in L1 and every thread has its own.
+ */
+
+#include "life.h"
+
+#define BOX_BLOCK 1024      /* columns per block */
+
+long box_row(char *out, const char *up, const char *mid, const char *down, int n)
+{
+    unsigned char sums[BOX_BLOCK + 2];
+    long count = 0;
+
+    for (int x0 = 0; x0 < n; x0 += BOX_BLOCK) {
+        const unsigned char *u = (const unsigned char *)up + x0;
+        const unsigned char *m = (const unsigned char *)mid + x0;
+        const unsigned char *d = (const unsigned char *)down + x0;
+        unsigned char *o = (unsigned char *)out + x0;
+        int len = n - x0 < BOX_BLOCK ? n - x0 : BOX_BLOCK;
+        unsigned block = 0;
+
+        /* sums[i] is column x0 + i - 1, the border or ghost columns included */
+        for (int i = 0; i < len + 2; i++) sums[i] = u[i - 1] + m[i - 1] + d[i - 1];
+
+        for (int i = 0; i < len; i++) {
+            unsigned char c = sums[i] + sums[i + 1] + sums[i + 2] - m[i];
+            o[i] = (c == 3) | ((c == 2) & m[i]);
+            block += o[i];
+        }
+        count += block;
+    }
+    return count;
+}
+
+long box_band(Grid *dst, const Grid *src, int y0, int y1)
+{
+    long count = 0;
+
+    for (int y = y0; y < y1; y++)
+        count += box_row(GRID_ROW(dst, y), GRID_ROW(src, y - 1), GRID_ROW(src, y),
+                         GRID_ROW(src, y + 1), src->width);
+    return count;
+}
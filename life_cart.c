@@ -0,0 +1,330 @@
+/*
+ * 2D block decomposition for the MPI drivers.
+ *
+ * The ranks form a Cartesian grid of dims[0] rows by dims[1] columns, and
+ * each holds one block of the world with depth ghost cells around it. The
+ * halo exchange is eight messages: depth edge rows to the ranks above and
+ * below, depth edge columns to the left and right, and a depth x depth
+ * corner to each diagonal neighbor, all strided vector datatypes, so
+ * nothing is packed. A rank sends about 2 (w_X / dims[1] + w_Y / dims[0])
+ * cells a generation, instead of 2 w_X when the world is split by rows.
+ *
+ * With depth k the exchange is needed only every k generations: each one
+ * updates the block plus a margin into the ghost cells, one less every
+ * generation, so the next one still reads valid cells. Past the edge of
+ * the world there is no margin and the ghost cells stay zero.
+ *
+ * The generations themselves are run here too, on the rank's threads, so
+ * the drivers differ only in how they start the exchange.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "life.h"
+
+/* Neighbor d is at (dir_y[d], dir_x[d]); the one opposite is 7 - d */
+static const int dir_y[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+static const int dir_x[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+
+/* Part i of n cells split in parts, the first n % parts parts one longer */
+static void split(int n, int parts, int i, int *start, int *len)
+{
+    *len = n / parts + (i < n % parts);
+    *start = i * (n / parts) + (i < n % parts ? i : n % parts);
+}
+
+/* Rows x columns of ranks with the fewest halo cells in all, which is the
+   length of the cuts: (py - 1) w_X + (px - 1) w_Y. MPI_Dims_create() would
+   make the grid as square as it can whatever the shape of the world. If
+   every split leaves some block empty, the world is split by rows. */
+static void choose_dims(int size, int w_X, int w_Y, int dims[2])
+{
+    double best = -1;
+
+    dims[0] = size;
+    dims[1] = 1;
+    for (int py = 1; py <= size; py++) {
+        int px = size / py;
+        double halo;
+
+        if (size % py != 0 || py > w_Y || px > w_X) continue;
+        halo = (double)(py - 1) * w_X + (double)(px - 1) * w_Y;
+        if (best < 0 || halo < best) {
+            best = halo;
+            dims[0] = py;
+            dims[1] = px;
+        }
+    }
+}
+
+void cart_init(Cart *c, int w_X, int w_Y, int depth)
+{
+    int periods[2] = { 0, 0 };
+    int side;
+
+    MPI_Comm_size(MPI_COMM_WORLD, &c->size);
+    choose_dims(c->size, w_X, w_Y, c->dims);
+    MPI_Cart_create(MPI_COMM_WORLD, 2, c->dims, periods, 1, &c->comm);
+    MPI_Comm_rank(c->comm, &c->rank);
+    MPI_Cart_coords(c->comm, c->rank, 2, c->coords);
+
+    c->w_X = w_X;
+    c->w_Y = w_Y;
+    split(w_Y, c->dims[0], c->coords[0], &c->y0, &c->local_w_Y);
+    split(w_X, c->dims[1], c->coords[1], &c->x0, &c->local_w_X);
+    for (int d = 0; d < 8; d++) c->halo[d] = MPI_DATATYPE_NULL;
+    c->threads = 1;
+
+    /* Ghost cells come from the next block only, so no deeper than the
+       smallest block is wide or high */
+    side = c->local_w_X < c->local_w_Y ? c->local_w_X : c->local_w_Y;
+    MPI_Allreduce(MPI_IN_PLACE, &side, 1, MPI_INT, MPI_MIN, c->comm);
+    c->depth = c->size > 1 && depth > side ? (side > 1 ? side : 1) : depth;
+
+    /* Past the edge of the world there is nobody: MPI_PROC_NULL makes those
+       messages no-ops and the ghost cells stay zero */
+    for (int d = 0; d < 8; d++) {
+        int at[2] = { c->coords[0] + dir_y[d], c->coords[1] + dir_x[d] };
+
+        if (at[0] < 0 || at[0] >= c->dims[0] || at[1] < 0 || at[1] >= c->dims[1])
+            c->nbr[d] = MPI_PROC_NULL;
+        else
+            MPI_Cart_rank(c->comm, at, &c->nbr[d]);
+    }
+}
+
+void cart_free(Cart *c)
+{
+    for (int d = 0; d < 8; d++) {
+        if (c->halo[d] != MPI_DATATYPE_NULL) MPI_Type_free(&c->halo[d]);
+    }
+    MPI_Comm_free(&c->comm);
+}
+
+void cart_region(const Cart *c, int margin, int r[4])
+{
+    r[0] = c->nbr[1] != MPI_PROC_NULL ? -margin : 0;
+    r[1] = c->local_w_Y + (c->nbr[6] != MPI_PROC_NULL ? margin : 0);
+    r[2] = c->nbr[3] != MPI_PROC_NULL ? -margin : 0;
+    r[3] = c->local_w_X + (c->nbr[4] != MPI_PROC_NULL ? margin : 0);
+}
+
+void cart_set(const Cart *c, Grid *g, int y, int x)
+{
+    if (y >= c->y0 && y < c->y0 + c->local_w_Y && x >= c->x0 && x < c->x0 + c->local_w_X)
+        CELL(g, y - c->y0, x - c->x0) = 1;
+}
+
+/* The halo exchange of g into requests: started now, or made persistent
+   for MPI_Startall() to start later */
+static int exchange(Cart *c, Grid *g, MPI_Request *requests, int persistent)
+{
+    int h = c->local_w_Y, w = c->local_w_X, k = c->depth, n = 0;
+
+    for (int d = 0; d < 8; d++) {
+        /* Ghost cells on side d, and the edge cells the neighbor there needs */
+        int gy = dir_y[d] < 0 ? -k : dir_y[d] > 0 ? h : 0;
+        int gx = dir_x[d] < 0 ? -k : dir_x[d] > 0 ? w : 0;
+        int ey = dir_y[d] > 0 ? h - k : 0;
+        int ex = dir_x[d] > 0 ? w - k : 0;
+
+        if (c->nbr[d] == MPI_PROC_NULL) continue;
+
+        /* Both grids have the same stride, so the types are made once */
+        if (c->halo[d] == MPI_DATATYPE_NULL) {
+            MPI_Type_vector(dir_y[d] ? k : h, dir_x[d] ? k : w, (int)g->stride, MPI_CHAR,
+                            &c->halo[d]);
+            MPI_Type_commit(&c->halo[d]);
+        }
+        if (persistent) {
+            MPI_Recv_init(GRID_ROW(g, gy) + gx, 1, c->halo[d], c->nbr[d], 7 - d, c->comm,
+                          &requests[n++]);
+            MPI_Send_init(GRID_ROW(g, ey) + ex, 1, c->halo[d], c->nbr[d], d, c->comm,
+                          &requests[n++]);
+        } else {
+            MPI_Irecv(GRID_ROW(g, gy) + gx, 1, c->halo[d], c->nbr[d], 7 - d, c->comm,
+                      &requests[n++]);
+            MPI_Isend(GRID_ROW(g, ey) + ex, 1, c->halo[d], c->nbr[d], d, c->comm,
+                      &requests[n++]);
+        }
+    }
+    return n;
+}
+
+int cart_start_exchange(Cart *c, Grid *g, MPI_Request *requests)
+{
+    return exchange(c, g, requests, 0);
+}
+
+int cart_exchange_init(Cart *c, Grid *g, MPI_Request *requests)
+{
+    return exchange(c, g, requests, 1);
+}
+
+/* Update rows [y0, y1) of columns [x0, x1) of src into dst and return
+   their population; with no band kernel this is the byte engine */
+static long update_rows(BandKernel band, Grid *dst, const Grid *src, int y0, int y1, int x0,
+                        int x1)
+{
+    long count = 0;
+    int c;
+
+    if (band) {
+        Grid d = grid_columns(dst, x0, x1), s = grid_columns(src, x0, x1);
+        return band(&d, &s, y0, y1);
+    }
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            /* The zero border and the ghost cells give every cell the same
+               eight neighbors */
+            c = CELL(src, y-1, x-1) + CELL(src, y-1, x) + CELL(src, y-1, x+1)
+                + CELL(src, y, x-1) + CELL(src, y, x+1)
+                + CELL(src, y+1, x-1) + CELL(src, y+1, x) + CELL(src, y+1, x+1);
+
+            if (c <= 1) CELL(dst, y, x) = 0;        /* die of loneliness */
+            else if (c >= 4) CELL(dst, y, x) = 0;   /* die of overpopulation */
+            else if (c == 3) CELL(dst, y, x) = 1;   /* becomes alive */
+            else CELL(dst, y, x) = CELL(src, y, x); /* c == 2, no change */
+            count += CELL(dst, y, x);
+        }
+    }
+    return count;
+}
+
+/* update_rows() on each of the rank's threads, each with its own band of
+   the rows */
+static long update_block(const Cart *c, BandKernel band, Grid *dst, const Grid *src, int y0,
+                         int y1, int x0, int x1)
+{
+    int parts = c->threads < y1 - y0 ? c->threads : y1 - y0;
+    long count = 0;
+
+    if (y0 >= y1 || x0 >= x1) return 0;
+    if (parts <= 1) return update_rows(band, dst, src, y0, y1, x0, x1);
+
+    #pragma omp parallel for num_threads(parts) reduction(+:count)
+    for (int p = 0; p < parts; p++) {
+        count += update_rows(band, dst, src, y0 + (int)((long)(y1 - y0) * p / parts),
+                             y0 + (int)((long)(y1 - y0) * (p + 1) / parts), x0, x1);
+    }
+    return count;
+}
+
+/* Update rows r[0] to r[1] - 1 by columns r[2] to r[3] - 1, less the
+   rectangle in inside them, and return their population */
+static long update_ring(const Cart *c, BandKernel band, Grid *dst, const Grid *src,
+                        const int r[4], const int in[4])
+{
+    return update_block(c, band, dst, src, r[0], in[0], r[2], r[3])
+           + update_block(c, band, dst, src, in[1], r[1], r[2], r[3])
+           + update_block(c, band, dst, src, in[0], in[1], r[2], in[2])
+           + update_block(c, band, dst, src, in[0], in[1], in[3], r[3]);
+}
+
+long cart_generation(const Cart *c, BandKernel band, Grid *dst, const Grid *src, int margin,
+                     MPI_Request *requests, int req_count)
+{
+    int block[4], inner[4], region[4];
+    long count;
+
+    cart_region(c, 0, block);
+    cart_region(c, margin, region);
+    inner[0] = block[1] < 1 ? block[1] : 1;
+    inner[1] = block[1] - 1 > inner[0] ? block[1] - 1 : inner[0];
+    inner[2] = block[3] < 1 ? block[3] : 1;
+    inner[3] = block[3] - 1 > inner[2] ? block[3] - 1 : inner[2];
+
+    count = update_block(c, band, dst, src, inner[0], inner[1], inner[2], inner[3]);
+    MPI_Waitall(req_count, requests, MPI_STATUSES_IGNORE);
+    count += update_ring(c, band, dst, src, block, inner);
+    update_ring(c, band, dst, src, region, block);  /* counted by the ranks they belong to */
+    return count;
+}
+
+Grid *cart_run(const Cart *c, BandKernel band, Grid views[3], Grid *start, int n,
+               MPI_Request *requests, int req_count, long *counts)
+{
+    Grid *next[2], *w = start;
+    int k = 0;
+
+    for (int i = 0; i < 3 && k < 2; i++) {
+        if (&views[i] != start) next[k++] = &views[i];
+    }
+
+    for (int g = 0; g < n; g++) {
+        counts[g] = cart_generation(c, band, next[g % 2], w, n - 1 - g, requests,
+                                    g == 0 ? req_count : 0);
+        w = next[g % 2];
+    }
+    return w;
+}
+
+int cart_keep_going(int iter, long count, long init_count)
+{
+    return (iter < 200) && (count < 50 * init_count) && (count > init_count / 50);
+}
+
+char *cart_gather(const Cart *c, const Grid *g)
+{
+    MPI_Datatype block;
+    MPI_Request request;
+    char *world = NULL;
+
+    /* Every rank sends its block straight out of the grid */
+    MPI_Type_vector(c->local_w_Y, c->local_w_X, (int)g->stride, MPI_CHAR, &block);
+    MPI_Type_commit(&block);
+    MPI_Isend(GRID_ROW(g, 0), 1, block, 0, 0, c->comm, &request);
+
+    if (c->rank == 0) {
+        int sizes[2] = { c->w_Y, c->w_X };
+
+        world = (char *)malloc((size_t)c->w_X * c->w_Y);
+        if (!world) {
+            printf("Error: Failed to allocate memory for global world\n");
+            MPI_Abort(c->comm, 1);
+        }
+
+        /* and rank 0 receives each one into its place in the world */
+        for (int r = 0; r < c->size; r++) {
+            int at[2], start[2], len[2];
+            MPI_Datatype place;
+
+            MPI_Cart_coords(c->comm, r, 2, at);
+            split(c->w_Y, c->dims[0], at[0], &start[0], &len[0]);
+            split(c->w_X, c->dims[1], at[1], &start[1], &len[1]);
+            if (len[0] == 0 || len[1] == 0) {
+                MPI_Recv(world, 0, MPI_CHAR, r, 0, c->comm, MPI_STATUS_IGNORE);
+                continue;
+            }
+            MPI_Type_create_subarray(2, sizes, len, start, MPI_ORDER_C, MPI_CHAR, &place);
+            MPI_Type_commit(&place);
+            MPI_Recv(world, 1, place, r, 0, c->comm, MPI_STATUS_IGNORE);
+            MPI_Type_free(&place);
+        }
+    }
+
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    MPI_Type_free(&block);
+    return world;
+}
+
+int cart_threads(int requested, int provided)
+{
+#ifdef _OPENMP
+    int threads = requested;
+
+    if (threads == 0) threads = getenv("OMP_NUM_THREADS") ? omp_get_max_threads() : 1;
+    if (provided < MPI_THREAD_FUNNELED) threads = 1;
+    return threads;
+#else
+    (void)requested;
+    (void)provided;
+    return 1;
+#endif
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "life.h"
+
+#define GRID_ALIGN 64
+#define HUGE_PAGE ((size_t)2 << 20)
+
+PageMode life_pages = PAGES_THP;
+
+int grid_alloc(Grid *g, int width, int height)
+{
+    if (grid_alloc_untouched(g, width, height) != 0) return -1;
+    memset(g->cells, 0, ((size_t)height + 2 * HALO) * g->stride);
+    return 0;
+}
+
+/* bytes (a multiple of HUGE_PAGE) of anonymous memory starting on a huge
+   page boundary, or NULL. hugetlb needs pages reserved in
+   /proc/sys/vm/nr_hugepages; transparent huge pages only need the kernel
+   to find free 2 MiB blocks when the pages are first touched. */
+static void *map_huge(size_t bytes, int hugetlb)
+{
+    char *p;
+    size_t head;
+
+    if (hugetlb) {
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        return p == MAP_FAILED ? NULL : p;
+    }
+
+    /* Map a huge page more and trim both ends to the boundary */
+    p = mmap(NULL, bytes + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    head = (HUGE_PAGE - (uintptr_t)p % HUGE_PAGE) % HUGE_PAGE;
+    if (head) munmap(p, head);
+    munmap(p + head + bytes, HUGE_PAGE - head);
+    p += head;
+    madvise(p, bytes, MADV_HUGEPAGE);
+    return p;
+}
+
+int grid_alloc_untouched(Grid *g, int width, int height)
+{
+    size_t rows = (size_t)height + 2 * HALO;
+    size_t bytes;
+    void *p;
+
+    /* Round rows up to whole cache lines so every row starts on one */
+    g->stride = ((size_t)width + 2 * HALO + GRID_ALIGN - 1) / GRID_ALIGN * GRID_ALIGN;
+    g->width = width;
+    g->height = height;
+    g->map_bytes = 0;
+    g->page_mode = life_pages;
+
+    bytes = rows * g->stride;
+    if (life_pages != PAGES_SMALL && bytes >= HUGE_PAGE) {
+        size_t mapped = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+
+        p = NULL;
+        if (life_pages == PAGES_HUGETLB) p = map_huge(mapped, 1);
+        if (!p) p = map_huge(mapped, 0);
+        if (p) {
+            g->cells = (char *)p;
+            g->map_bytes = mapped;
+            return 0;
+        }
+    }
+
+    if (posix_memalign(&p, GRID_ALIGN, bytes) != 0) {
+        g->cells = NULL;
+        return -1;
+    }
+    g->cells = (char *)p;
+    return 0;
+}
+
+void grid_zero_rows(Grid *g, int y0, int y1)
+{
+    if (y0 < -HALO) y0 = -HALO;
+    if (y1 > g->height + HALO) y1 = g->height + HALO;
+    if (y0 < y1) memset(g->cells + (size_t)(y0 + HALO) * g->stride, 0, (size_t)(y1 - y0) * g->stride);
+}
+
+Grid grid_columns(const Grid *g, int x0, int x1)
+{
+    Grid view = *g;
+
+    view.cells = g->cells + x0;
+    view.width = x1 - x0;
+    view.map_bytes = 0;
+    return view;
+}
+
+Grid grid_inset(const Grid *g, int margin)
+{
+    Grid view = *g;
+
+    view.cells = g->cells + (size_t)margin * g->stride + margin;
+    view.width = g->width - 2 * margin;
+    view.height = g->height - 2 * margin;
+    view.map_bytes = 0;
+    return view;
+}
+
+void grid_free(Grid *g)
+{
+    if (g->map_bytes) munmap(g->cells, g->map_bytes);
+    else free(g->cells);
+    g->cells = NULL;
+    g->map_bytes = 0;
+}
+
+int grid_describe_pages(const Grid *g, char *buf, size_t len)
+{
+    uintptr_t addr = (uintptr_t)g->cells;
+    unsigned long lo, hi;
+    long size = 0, page = 0, huge = 0;
+    int in = 0;
+    char line[256];
+    const char *fell_back;
+    FILE *fd;
+
+    if (((size_t)g->height + 2 * HALO) * g->stride < HUGE_PAGE) return -1;
+    if (!g->map_bytes) {
+        if (g->page_mode == PAGES_SMALL)
+            snprintf(buf, len, "4 KiB pages (--pages=small)");
+        else
+            snprintf(buf, len, "4 KiB pages (%s unavailable, fell back)",
+                     g->page_mode == PAGES_HUGETLB ? "hugetlb" : "thp");
+        return 0;
+    }
+
+    /* The kernel's account of the mapping holding the grid */
+    if ((fd = fopen("/proc/self/smaps", "r")) == NULL) return -1;
+    while (fgets(line, sizeof(line), fd)) {
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+            if (in) break;
+            in = addr >= lo && addr < hi;
+        } else if (in) {
+            sscanf(line, "Size: %ld kB", &size);
+            sscanf(line, "KernelPageSize: %ld kB", &page);
+            sscanf(line, "AnonHugePages: %ld kB", &huge);
+        }
+    }
+    fclose(fd);
+
+    /* Asked for hugetlb pages but mapped without them */
+    fell_back = g->page_mode == PAGES_HUGETLB ? ", hugetlb unavailable, fell back" : "";
+    if (page > 4)
+        snprintf(buf, len, "%ld KiB hugetlb pages", page);
+    else if (huge > 0)
+        snprintf(buf, len, "2 MiB transparent huge pages for %ld of %ld MiB%s",
+                 huge >> 10, size >> 10, fell_back);
+    else
+        snprintf(buf, len, "4 KiB pages (no huge pages were available%s)", fell_back);
+    return 0;
+}
@@ -0,0 +1,425 @@
+/*
+ * Hashlife engine: the world as a hash-consed quadtree with memoized steps.
+ *
+ * A node of level k is a 2^k x 2^k square made of four level k-1 children;
+ * equal squares are the same node, so a repetitive world such as the two
+ * diagonals of init() is stored once per distinct block. advance() gives
+ * the centre 2^(k-1) square of a node 2^j generations on and remembers the
+ * answer in the node, so every distinct block is only ever computed once.
+ *
+ * The drivers' world is bounded: cells past the edge are dead and stay
+ * dead. Here that is a third cell state, the wall, which is never alive,
+ * never changes and counts as a dead neighbor. Everything outside the
+ * world is wall, so the quadtree can grow past the edge without the
+ * pattern leaking out of it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "life.h"
+
+#define HL_DEAD 0
+#define HL_ALIVE 1
+#define HL_WALL 2
+
+#define HL_MAX_LEVEL 40
+#define NODE_CHUNK 65536
+
+typedef struct HLNode HLNode;
+
+struct HLNode {
+    HLNode *nw, *ne, *sw, *se;  /* quadrants, NULL for a single cell */
+    HLNode *next;               /* hash chain, or free list */
+    HLNode *result;             /* memo of advance(this, result_j) */
+    long pop;                   /* live cells; walls are not counted */
+    int level;
+    signed char result_j;       /* -1 while there is no memo */
+    unsigned char state;        /* level 0 only: HL_DEAD, HL_ALIVE, HL_WALL */
+    unsigned char mark;         /* reachable, during collect() */
+};
+
+static HLNode leaves[3];
+static HLNode *walls[HL_MAX_LEVEL + 1];     /* all-wall square of each level */
+static HLNode *empty[HL_MAX_LEVEL + 1];     /* all-dead square of each level */
+
+/* Hash-consing table, chained through HLNode.next */
+static HLNode **table = NULL;
+static size_t table_size = 0;
+static size_t live_nodes = 0;
+static size_t max_nodes = 0;
+
+/* Nodes come from chunks of NODE_CHUNK; freed ones go on a free list */
+static HLNode **chunks = NULL;
+static size_t num_chunks = 0;
+static HLNode *free_nodes = NULL;
+
+static HLNode *root = NULL;                 /* the world, at (0, 0) */
+static HLNode *saved = NULL;                /* hashlife_checkpoint() */
+
+static void out_of_memory(void)
+{
+    printf("Error: Failed to allocate memory for the hashlife nodes\n");
+    exit(1);
+}
+
+static size_t hash4(const HLNode *a, const HLNode *b, const HLNode *c, const HLNode *d)
+{
+    uint64_t h = (uintptr_t)a;
+
+    h = h * 0x9e3779b97f4a7c15ULL + (uintptr_t)b;
+    h = h * 0x9e3779b97f4a7c15ULL + (uintptr_t)c;
+    h = h * 0x9e3779b97f4a7c15ULL + (uintptr_t)d;
+    return (size_t)(h ^ (h >> 29));
+}
+
+static void grow_table(void)
+{
+    size_t size = table_size ? 2 * table_size : 1 << 16;
+    HLNode **t = (HLNode **)calloc(size, sizeof(HLNode *));
+
+    if (!t) out_of_memory();
+    for (size_t i = 0; i < table_size; i++) {
+        HLNode *n = table[i];
+        while (n) {
+            HLNode *next = n->next;
+            size_t h = hash4(n->nw, n->ne, n->sw, n->se) & (size - 1);
+            n->next = t[h];
+            t[h] = n;
+            n = next;
+        }
+    }
+    free(table);
+    table = t;
+    table_size = size;
+}
+
+static HLNode *new_node(void)
+{
+    HLNode *n;
+
+    if (!free_nodes) {
+        HLNode *block = (HLNode *)malloc(NODE_CHUNK * sizeof(HLNode));
+        HLNode **list = (HLNode **)realloc(chunks, (num_chunks + 1) * sizeof(HLNode *));
+
+        if (!list) out_of_memory();
+        chunks = list;
+        if (!block) out_of_memory();
+        chunks[num_chunks++] = block;
+        for (int i = NODE_CHUNK - 1; i >= 0; i--) {
+            block[i].next = free_nodes;
+            free_nodes = &block[i];
+        }
+    }
+    n = free_nodes;
+    free_nodes = n->next;
+    return n;
+}
+
+/* The unique node with these quadrants */
+static HLNode *find_node(HLNode *nw, HLNode *ne, HLNode *sw, HLNode *se)
+{
+    size_t h = hash4(nw, ne, sw, se) & (table_size - 1);
+    HLNode *n;
+
+    for (n = table[h]; n; n = n->next) {
+        if (n->nw == nw && n->ne == ne && n->sw == sw && n->se == se) return n;
+    }
+
+    n = new_node();
+    n->nw = nw;
+    n->ne = ne;
+    n->sw = sw;
+    n->se = se;
+    n->pop = nw->pop + ne->pop + sw->pop + se->pop;
+    n->level = nw->level + 1;
+    n->result = NULL;
+    n->result_j = -1;
+    n->state = 0;
+    n->mark = 0;
+    n->next = table[h];
+    table[h] = n;
+
+    if (++live_nodes > table_size) grow_table();
+    return n;
+}
+
+/* Centre half of a node, no time step */
+static HLNode *centre(HLNode *n)
+{
+    return find_node(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+/* State of cell (y, x) of a level 2 node */
+static int cell_state(const HLNode *n, int y, int x)
+{
+    const HLNode *q = y < 2 ? (x < 2 ? n->nw : n->ne) : (x < 2 ? n->sw : n->se);
+    const HLNode *c = (y & 1) ? ((x & 1) ? q->se : q->sw) : ((x & 1) ? q->ne : q->nw);
+    return c->state;
+}
+
+/* Level 2: the centre 2x2 one generation on, by the rule itself */
+static HLNode *step_level2(const HLNode *n)
+{
+    HLNode *out[4];
+
+    for (int i = 0; i < 4; i++) {
+        int y = 1 + i / 2, x = 1 + i % 2;
+        int s = cell_state(n, y, x), c = 0;
+
+        if (s == HL_WALL) {
+            out[i] = &leaves[HL_WALL];
+            continue;
+        }
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if ((dy || dx) && cell_state(n, y + dy, x + dx) == HL_ALIVE) c++;
+            }
+        }
+        out[i] = &leaves[(c == 3 || (c == 2 && s == HL_ALIVE)) ? HL_ALIVE : HL_DEAD];
+    }
+    return find_node(out[0], out[1], out[2], out[3]);
+}
+
+/*
+ * Centre 2^(k-1) square of a level k node, 2^j generations on
+ * (0 <= j <= k - 2). The node is cut into nine overlapping level k-1
+ * squares; at full speed (j = k - 2) each is advanced half the way and
+ * the four overlapping results the other half, otherwise only the last
+ * half-step advances and the nine are just centred.
+ */
+static HLNode *advance(HLNode *n, int j)
+{
+    HLNode *sub[9], *r[9], *result;
+    int fast;
+
+    if (n->result_j == j) return n->result;
+
+    if (n->level == 2) {
+        result = step_level2(n);
+    } else {
+        fast = (j == n->level - 2);
+
+        sub[0] = n->nw;
+        sub[1] = find_node(n->nw->ne, n->ne->nw, n->nw->se, n->ne->sw);
+        sub[2] = n->ne;
+        sub[3] = find_node(n->nw->sw, n->nw->se, n->sw->nw, n->sw->ne);
+        sub[4] = find_node(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+        sub[5] = find_node(n->ne->sw, n->ne->se, n->se->nw, n->se->ne);
+        sub[6] = n->sw;
+        sub[7] = find_node(n->sw->ne, n->se->nw, n->sw->se, n->se->sw);
+        sub[8] = n->se;
+
+        for (int i = 0; i < 9; i++) r[i] = fast ? advance(sub[i], j - 1) : centre(sub[i]);
+
+        if (fast) j--;
+        result = find_node(advance(find_node(r[0], r[1], r[3], r[4]), j),
+                           advance(find_node(r[1], r[2], r[4], r[5]), j),
+                           advance(find_node(r[3], r[4], r[6], r[7]), j),
+                           advance(find_node(r[4], r[5], r[7], r[8]), j));
+        if (fast) j++;
+    }
+
+    n->result = result;
+    n->result_j = (signed char)j;
+    return result;
+}
+
+/* Mark everything reachable from n; the leaves are static and skipped */
+static void mark(HLNode *n)
+{
+    if (!n || n->level == 0 || n->mark) return;
+    n->mark = 1;
+    mark(n->nw);
+    mark(n->ne);
+    mark(n->sw);
+    mark(n->se);
+}
+
+/*
+ * Free every node the world, the checkpoint and the walls do not use.
+ * Memos are dropped when their result goes, which is what makes the
+ * cache shrink. Only called between steps, when no advance() is running.
+ */
+static void collect(void)
+{
+    mark(root);
+    mark(saved);
+    for (int k = 0; k <= HL_MAX_LEVEL && walls[k]; k++) {
+        mark(walls[k]);
+        mark(empty[k]);
+    }
+
+    for (size_t i = 0; i < table_size; i++) {
+        HLNode **link = &table[i];
+        while (*link) {
+            HLNode *n = *link;
+            if (n->mark) {
+                link = &n->next;
+            } else {
+                *link = n->next;
+                n->next = free_nodes;
+                free_nodes = n;
+                live_nodes--;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < table_size; i++) {
+        for (HLNode *n = table[i]; n; n = n->next) {
+            if (n->result && n->result->level > 0 && !n->result->mark) {
+                n->result = NULL;
+                n->result_j = -1;
+            }
+        }
+    }
+    for (size_t i = 0; i < table_size; i++) {
+        for (HLNode *n = table[i]; n; n = n->next) n->mark = 0;
+    }
+}
+
+/* Whether the size x size block at world (y0, x0) is inside g and dead */
+static int block_is_empty(const Grid *g, int size, long y0, long x0)
+{
+    if (y0 + size > g->height || x0 + size > g->width) return 0;
+    for (long y = y0; y < y0 + size; y++) {
+        const char *row = GRID_ROW(g, y) + x0;
+        for (int x = 0; x < size; x++) {
+            if (row[x]) return 0;
+        }
+    }
+    return 1;
+}
+
+/* Level `level` square at world (y0, x0) from the grid, wall past its edge */
+static HLNode *build(const Grid *g, int level, long y0, long x0)
+{
+    long h;
+
+    if (y0 >= g->height || x0 >= g->width) return walls[level];
+
+    /* Most of a world is empty; one scan of a small block is much cheaper
+       than building it a cell at a time */
+    if (level == 6 && block_is_empty(g, 64, y0, x0)) return empty[level];
+    if (level == 0) return &leaves[CELL(g, y0, x0) == 1 ? HL_ALIVE : HL_DEAD];
+
+    h = 1L << (level - 1);
+    return find_node(build(g, level - 1, y0, x0), build(g, level - 1, y0, x0 + h),
+                     build(g, level - 1, y0 + h, x0), build(g, level - 1, y0 + h, x0 + h));
+}
+
+/* Write the live cells of n, a square at world (y0, x0), into g */
+static void store(const HLNode *n, Grid *g, long y0, long x0)
+{
+    long h;
+
+    if (n->pop == 0) return;
+    if (n->level == 0) {
+        CELL(g, y0, x0) = 1;
+        return;
+    }
+
+    h = 1L << (n->level - 1);
+    store(n->nw, g, y0, x0);
+    store(n->ne, g, y0, x0 + h);
+    store(n->sw, g, y0 + h, x0);
+    store(n->se, g, y0 + h, x0 + h);
+}
+
+int hashlife_load(const Grid *g, size_t mem_limit)
+{
+    int level = 1;
+
+    hashlife_free();
+
+    for (int s = 0; s < 3; s++) {
+        memset(&leaves[s], 0, sizeof(leaves[s]));
+        leaves[s].state = (unsigned char)s;
+        leaves[s].pop = (s == HL_ALIVE);
+        leaves[s].result_j = -1;
+    }
+
+    /* Smallest square that holds the world; it has to have quadrants */
+    while (level < HL_MAX_LEVEL - 1 &&
+           ((1L << level) < g->width || (1L << level) < g->height))
+        level++;
+    if ((1L << level) < g->width || (1L << level) < g->height) return -1;
+
+    max_nodes = mem_limit / (sizeof(HLNode) + sizeof(HLNode *));
+    grow_table();
+
+    walls[0] = &leaves[HL_WALL];
+    empty[0] = &leaves[HL_DEAD];
+    for (int k = 1; k <= level + 1; k++) {
+        walls[k] = find_node(walls[k - 1], walls[k - 1], walls[k - 1], walls[k - 1]);
+        empty[k] = find_node(empty[k - 1], empty[k - 1], empty[k - 1], empty[k - 1]);
+    }
+
+    /* No cells at all: an empty universe, which stays empty */
+    if (g->width <= 0 || g->height <= 0) {
+        root = empty[level];
+        return 0;
+    }
+    root = build(g, level, 0, 0);
+    return 0;
+}
+
+int hashlife_max_step(void)
+{
+    return root->level - 1;
+}
+
+long hashlife_step(int j)
+{
+    HLNode *W = walls[root->level - 1];
+    HLNode *big;
+
+    if (live_nodes > max_nodes) collect();
+
+    /* Put the world in the middle of a square twice its size with wall
+       all round; the centre of that, advanced, is the world again */
+    big = find_node(find_node(W, W, W, root->nw), find_node(W, W, root->ne, W),
+                    find_node(W, root->sw, W, W), find_node(root->se, W, W, W));
+    root = advance(big, j);
+    return root->pop;
+}
+
+void hashlife_checkpoint(void)
+{
+    saved = root;
+}
+
+void hashlife_rollback(void)
+{
+    root = saved;
+}
+
+void hashlife_store(Grid *g)
+{
+    if (g->width <= 0 || g->height <= 0) return;
+    for (int y = 0; y < g->height; y++) memset(GRID_ROW(g, y), 0, g->width);
+    store(root, g, 0, 0);
+}
+
+size_t hashlife_nodes(void)
+{
+    return live_nodes;
+}
+
+void hashlife_free(void)
+{
+    for (size_t i = 0; i < num_chunks; i++) free(chunks[i]);
+    free(chunks);
+    free(table);
+    chunks = NULL;
+    num_chunks = 0;
+    table = NULL;
+    table_size = 0;
+    live_nodes = 0;
+    free_nodes = NULL;
+    root = saved = NULL;
+    memset(walls, 0, sizeof(walls));
+    memset(empty, 0, sizeof(empty));
+}
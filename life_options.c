@@ -0,0 +1,233 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "life.h"
+
+static const char *engine_names[] = {
+    "byte",
+    "bitpack",
+    "simd",
+    "tiled",
+    "hashlife",
+    "sparse",
+    "lut",
+    "box"
+};
+
+#define NUM_ENGINES ((int)(sizeof(engine_names) / sizeof(engine_names[0])))
+
+int life_quiet = 0;
+
+/* printf() for the error messages, unless life_quiet is set */
+static void note(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (life_quiet) return;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+const char *engine_name(Engine engine)
+{
+    if ((int)engine < 0 || (int)engine >= NUM_ENGINES) return "unknown";
+    return engine_names[engine];
+}
+
+static int parse_engine(const char *name, Engine *engine)
+{
+    for (int i = 0; i < NUM_ENGINES; i++) {
+        if (strcmp(name, engine_names[i]) == 0) {
+            *engine = (Engine)i;
+            return 0;
+        }
+    }
+
+    note("Unknown engine: %s (expected one of:", name);
+    for (int i = 0; i < NUM_ENGINES; i++) note(" %s", engine_names[i]);
+    note(")\n");
+    return -1;
+}
+
+static int parse_pages(const char *name, PageMode *pages)
+{
+    if (strcmp(name, "small") == 0) *pages = PAGES_SMALL;
+    else if (strcmp(name, "thp") == 0) *pages = PAGES_THP;
+    else if (strcmp(name, "hugetlb") == 0) *pages = PAGES_HUGETLB;
+    else {
+        note("Unknown page size: %s (expected one of: small thp hugetlb)\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Parse the value of --name=value as an int in [lo, hi] */
+static int parse_int(const char *arg, const char *value, int lo, int hi, int *out)
+{
+    char *end;
+    long v = strtol(value, &end, 10);
+
+    if (*value == '\0' || *end != '\0' || v < lo || v > hi) {
+        note("Bad value in %s (expected %d to %d)\n", arg, lo, hi);
+        return -1;
+    }
+    *out = (int)v;
+    return 0;
+}
+
+/* --tile=N for N x N tiles, --tile=WxH for W columns by H rows */
+static int parse_tile(const char *arg, LifeOptions *opts)
+{
+    char value[32];
+    char *x;
+
+    snprintf(value, sizeof(value), "%s", arg + 7);
+    x = strchr(value, 'x');
+    if (x) *x = '\0';
+    if (parse_int(arg, value, 1, 1 << 20, &opts->tile_w) != 0) return -1;
+    opts->tile_h = opts->tile_w;
+    if (x && parse_int(arg, x + 1, 1, 1 << 20, &opts->tile_h) != 0) return -1;
+    return 0;
+}
+
+int life_parse_options(int *argc, char *argv[], LifeOptions *opts)
+{
+    int i, kept = 1;
+
+    opts->engine = ENGINE_BYTE;
+    opts->engine_set = 0;
+    opts->isa = NULL;
+    opts->tile_w = 1024;
+    opts->tile_h = 256;
+    opts->tile_set = 0;
+    opts->tsteps = 8;
+    opts->hl_step = 0;
+    opts->hl_mem = 1024;
+    opts->active = 0;
+    opts->task_us = 0;
+    opts->pin = 0;
+    opts->dataflow = 0;
+    opts->omp_tune = 0;
+    opts->omp_profile = NULL;
+    opts->tune = 0;
+    opts->profile = LIFE_PROFILE;
+    opts->pages = PAGES_THP;
+    opts->ghost = 1;
+    opts->threads = 0;
+
+    for (i = 1; i < *argc; i++) {
+        const char *arg = argv[i];
+
+        if (strncmp(arg, "--", 2) != 0) {
+            /* Positional argument, keep it in order */
+            argv[kept++] = argv[i];
+            continue;
+        }
+
+        if (strncmp(arg, "--engine=", 9) == 0) {
+            if (parse_engine(arg + 9, &opts->engine) != 0) return -1;
+            opts->engine_set = 1;
+        } else if (strncmp(arg, "--isa=", 6) == 0) {
+            opts->isa = arg + 6;
+        } else if (strncmp(arg, "--tile=", 7) == 0) {
+            if (parse_tile(arg, opts) != 0) return -1;
+            opts->tile_set = 1;
+        } else if (strncmp(arg, "--tsteps=", 9) == 0) {
+            if (parse_int(arg, arg + 9, 1, TILED_MAX_STEPS, &opts->tsteps) != 0)
+                return -1;
+        } else if (strncmp(arg, "--hl-step=", 10) == 0) {
+            if (parse_int(arg, arg + 10, 0, 30, &opts->hl_step) != 0) return -1;
+        } else if (strncmp(arg, "--hl-mem=", 9) == 0) {
+            if (parse_int(arg, arg + 9, 1, 1 << 30, &opts->hl_mem) != 0) return -1;
+        } else if (strncmp(arg, "--active=", 9) == 0) {
+            if (parse_int(arg, arg + 9, 0, 1 << 20, &opts->active) != 0) return -1;
+        } else if (strcmp(arg, "--pin") == 0) {
+            opts->pin = 1;
+        } else if (strcmp(arg, "--dataflow") == 0) {
+            opts->dataflow = 1;
+        } else if (strcmp(arg, "--tune") == 0) {
+            opts->tune = 1;
+        } else if (strncmp(arg, "--profile=", 10) == 0) {
+            opts->profile = arg + 10;
+        } else if (strncmp(arg, "--ghost=", 8) == 0) {
+            if (parse_int(arg, arg + 8, 1, GHOST_MAX_DEPTH, &opts->ghost) != 0) return -1;
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            if (parse_int(arg, arg + 10, 1, 1024, &opts->threads) != 0) return -1;
+        } else if (strncmp(arg, "--pages=", 8) == 0) {
+            if (parse_pages(arg + 8, &opts->pages) != 0) return -1;
+        } else if (strcmp(arg, "--omp-tune") == 0) {
+            opts->omp_tune = 1;
+        } else if (strncmp(arg, "--omp-tune=", 11) == 0) {
+            opts->omp_tune = 1;
+            opts->omp_profile = arg + 11;
+        } else if (strncmp(arg, "--task-us=", 10) == 0) {
+            if (parse_int(arg, arg + 10, 0, 10000000, &opts->task_us) != 0) return -1;
+        } else {
+            note("Unknown option: %s\n", arg);
+            return -1;
+        }
+    }
+
+    argv[kept] = NULL;
+    *argc = kept;
+    life_pages = opts->pages;   /* grid_alloc() sees no options */
+    return 0;
+}
+
+int life_check_engine(const LifeOptions *opts, unsigned supported)
+{
+    if (opts->active && opts->engine != ENGINE_BYTE && opts->engine != ENGINE_SIMD) {
+        note("--active works with the byte and simd engines only\n");
+        return -1;
+    }
+    if (supported & ENGINE_BIT(opts->engine)) return 0;
+
+    note("The %s engine is not available in this program (use one of:",
+         engine_name(opts->engine));
+    for (int i = 0; i < NUM_ENGINES; i++) {
+        if (supported & ENGINE_BIT(i)) note(" %s", engine_names[i]);
+    }
+    note(")\n");
+    return -1;
+}
+
+void life_print_options(void)
+{
+    printf("Options:\n");
+    printf("  --engine=NAME  update engine:");
+    for (int i = 0; i < NUM_ENGINES; i++) printf(" %s", engine_names[i]);
+    printf(" (default byte, or\n"
+           "                 the fastest in the machine profile)\n");
+    printf("  --tune         time the engines on this machine, write the profile and exit\n");
+    printf("  --profile=FILE machine profile (default %s)\n", LIFE_PROFILE);
+    printf("  --pages=MODE   grid memory: small (4 KiB pages), thp (transparent huge\n"
+           "                 pages) or hugetlb (reserved huge pages); default thp\n");
+    printf("  --isa=NAME     widest vector kernel: avx512 avx2 sse2 scalar\n");
+    printf("  --tile=WxH     tiled engine: tile width and height, or N for N x N\n"
+           "                 (default 1024x256)\n");
+    printf("  --tsteps=K     tiled engine: generations per pass, 1 to %d (default 8)\n",
+           TILED_MAX_STEPS);
+    printf("  --hl-step=K    hashlife: jump 2^K generations at a time, printing\n"
+           "                 one line per jump (default 0, every generation); the\n"
+           "                 population stop rule is only checked between jumps,\n"
+           "                 so only K = 0 always stops where the byte engine does\n");
+    printf("  --hl-mem=MB    hashlife: node cache limit (default 1024)\n");
+    printf("  --active=N     byte/simd: only recompute N x N tiles near a change,\n"
+           "                 and print the active tile count (default 0, off)\n");
+    printf("  --task-us=T    pthread: size chunks from measured task times so a task\n"
+           "                 takes about T microseconds (default 0, fixed chunks)\n");
+    printf("  --pin          omp/pthread: pin each thread to its own CPU\n");
+    printf("  --dataflow     omp: run bands of rows as tasks that wait only for the\n"
+           "                 bands they read, with no barrier between generations\n");
+    printf("  --ghost=K      mpi: keep K ghost cells around each block and exchange\n"
+           "                 them every K generations, 1 to %d (default 1)\n", GHOST_MAX_DEPTH);
+    printf("  --threads=N    mpi: OpenMP threads updating each rank's block (default\n"
+           "                 OMP_NUM_THREADS if set, else 1), e.g. a rank per socket\n"
+           "                 with a thread per core\n");
+    printf("  --omp-tune[=FILE]  omp, byte/simd: time a set of schedules and row or\n"
+           "                 tile splits over the first generations and keep the\n"
+           "                 fastest; FILE keeps the choice for later runs\n");
+}
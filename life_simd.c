@@ -0,0 +1,275 @@
+/*
+ * Vector update kernel for the char-per-cell grid.
+ *
+ * A row is computed from the three rows around it: the eight neighbors
+ * are added as whole vectors of cells (16, 32 or 64 per instruction) and
+ * the rule is applied with compares and masks instead of the branch chain.
+ * The population of the new row is added up in the same pass.
+ * The widest instruction set the CPU supports is picked at startup, so one
+ * binary runs on every node.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "life.h"
+
+#if defined(__x86_64__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+RowKernel simd_row = NULL;
+static const char *simd_isa_name = "none";
+
+long scalar_row(char *out, const char *up, const char *mid,
+                const char *down, int n)
+{
+    long count = 0;
+
+    for (int i = 0; i < n; i++) {
+        int c = up[i-1] + up[i] + up[i+1] + mid[i-1] + mid[i+1]
+                + down[i-1] + down[i] + down[i+1];
+        out[i] = (char)((c == 3) | ((c == 2) & mid[i]));
+        count += out[i];
+    }
+    return count;
+}
+
+#if HAVE_X86_SIMD
+
+/* 32 zero bytes then 32 0xff bytes: a 32-byte load from tail_lanes + k
+   (a 16-byte one from tail_lanes + 16 + k) has its last k lanes set */
+static const char tail_lanes[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+/* Next state (0 or 1 per byte) of the 16 cells from mid + i */
+__attribute__((target("sse2")))
+static inline __m128i life_sse2(const char *up, const char *mid,
+                                const char *down, int i)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi8(2);
+    const __m128i three = _mm_set1_epi8(3);
+    __m128i m = _mm_loadu_si128((const __m128i *)(mid + i));
+    __m128i c = _mm_add_epi8(
+        _mm_add_epi8(
+            _mm_add_epi8(_mm_loadu_si128((const __m128i *)(up + i - 1)),
+                         _mm_loadu_si128((const __m128i *)(up + i))),
+            _mm_add_epi8(_mm_loadu_si128((const __m128i *)(up + i + 1)),
+                         _mm_loadu_si128((const __m128i *)(mid + i - 1)))),
+        _mm_add_epi8(
+            _mm_add_epi8(_mm_loadu_si128((const __m128i *)(mid + i + 1)),
+                         _mm_loadu_si128((const __m128i *)(down + i - 1))),
+            _mm_add_epi8(_mm_loadu_si128((const __m128i *)(down + i)),
+                         _mm_loadu_si128((const __m128i *)(down + i + 1)))));
+
+    /* alive = (c == 3) | ((c == 2) & mid) */
+    return _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(c, three), one),
+                        _mm_and_si128(_mm_cmpeq_epi8(c, two), m));
+}
+
+__attribute__((target("sse2")))
+static long row_sse2(char *out, const char *up, const char *mid,
+                     const char *down, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i r = life_sse2(up, mid, down, i);
+        _mm_storeu_si128((__m128i *)(out + i), r);
+
+        /* Horizontal byte sums into the two 64-bit lanes */
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(r, zero));
+    }
+
+    /* Tail: redo the last 16 cells of the row, which rewrites some cells
+       with the same values, and count only the ones not seen yet */
+    if (i < n && n >= 16) {
+        __m128i r = life_sse2(up, mid, down, n - 16);
+        __m128i fresh = _mm_loadu_si128((const __m128i *)(tail_lanes + 16 + n - i));
+        _mm_storeu_si128((__m128i *)(out + n - 16), r);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_and_si128(r, fresh), zero));
+        i = n;
+    }
+
+    return _mm_cvtsi128_si64(sum) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(sum, sum))
+           + scalar_row(out + i, up + i, mid + i, down + i, n - i);
+}
+
+/* Next state (0 or 1 per byte) of the 32 cells from mid + i */
+__attribute__((target("avx2")))
+static inline __m256i life_avx2(const char *up, const char *mid,
+                                const char *down, int i)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+    const __m256i three = _mm256_set1_epi8(3);
+    __m256i m = _mm256_loadu_si256((const __m256i *)(mid + i));
+    __m256i c = _mm256_add_epi8(
+        _mm256_add_epi8(
+            _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(up + i - 1)),
+                            _mm256_loadu_si256((const __m256i *)(up + i))),
+            _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(up + i + 1)),
+                            _mm256_loadu_si256((const __m256i *)(mid + i - 1)))),
+        _mm256_add_epi8(
+            _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(mid + i + 1)),
+                            _mm256_loadu_si256((const __m256i *)(down + i - 1))),
+            _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(down + i)),
+                            _mm256_loadu_si256((const __m256i *)(down + i + 1)))));
+
+    return _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(c, three), one),
+                           _mm256_and_si256(_mm256_cmpeq_epi8(c, two), m));
+}
+
+__attribute__((target("avx2")))
+static long row_avx2(char *out, const char *up, const char *mid,
+                     const char *down, int n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum = zero;
+    int i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i r = life_avx2(up, mid, down, i);
+        _mm256_storeu_si256((__m256i *)(out + i), r);
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(r, zero));
+    }
+
+    /* Tail: overlapping last vector, as in row_sse2() */
+    if (i < n && n >= 32) {
+        __m256i r = life_avx2(up, mid, down, n - 32);
+        __m256i fresh = _mm256_loadu_si256((const __m256i *)(tail_lanes + n - i));
+        _mm256_storeu_si256((__m256i *)(out + n - 32), r);
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_and_si256(r, fresh), zero));
+        i = n;
+    }
+
+    return _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1)
+           + _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3)
+           + row_sse2(out + i, up + i, mid + i, down + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static long row_avx512(char *out, const char *up, const char *mid,
+                       const char *down, int n)
+{
+    long count = 0;
+    const __m512i one = _mm512_set1_epi8(1);
+    const __m512i two = _mm512_set1_epi8(2);
+    const __m512i three = _mm512_set1_epi8(3);
+
+    for (int i = 0; i < n; i += 64) {
+        /* The last vector may be partial: masked-off lanes are neither
+           read nor written, and load as zero so they stay dead */
+        __mmask64 lanes = n - i >= 64 ? ~(__mmask64)0
+                                      : ~(__mmask64)0 >> (64 - (n - i));
+        __m512i m = _mm512_maskz_loadu_epi8(lanes, mid + i);
+        __m512i c = _mm512_add_epi8(
+            _mm512_add_epi8(
+                _mm512_add_epi8(_mm512_maskz_loadu_epi8(lanes, up + i - 1),
+                                _mm512_maskz_loadu_epi8(lanes, up + i)),
+                _mm512_add_epi8(_mm512_maskz_loadu_epi8(lanes, up + i + 1),
+                                _mm512_maskz_loadu_epi8(lanes, mid + i - 1))),
+            _mm512_add_epi8(
+                _mm512_add_epi8(_mm512_maskz_loadu_epi8(lanes, mid + i + 1),
+                                _mm512_maskz_loadu_epi8(lanes, down + i - 1)),
+                _mm512_add_epi8(_mm512_maskz_loadu_epi8(lanes, down + i),
+                                _mm512_maskz_loadu_epi8(lanes, down + i + 1))));
+
+        /* Live where c == 3, or c == 2 and already alive; the mask
+           popcount is the population of these 64 cells */
+        __mmask64 is3 = _mm512_cmpeq_epi8_mask(c, three);
+        __mmask64 is2 = _mm512_cmpeq_epi8_mask(c, two);
+        __mmask64 live = is3 | (is2 & _mm512_test_epi8_mask(m, m));
+        _mm512_mask_storeu_epi8(out + i, lanes, _mm512_maskz_mov_epi8(live, one));
+        count += __builtin_popcountll(live);
+    }
+
+    return count;
+}
+
+#endif
+
+/* Kernels from widest to narrowest */
+static const struct {
+    const char *name;
+    RowKernel kernel;
+} simd_kernels[] = {
+#if HAVE_X86_SIMD
+    { "avx512", row_avx512 },
+    { "avx2", row_avx2 },
+    { "sse2", row_sse2 },
+#endif
+    { "scalar", scalar_row }
+};
+
+#define NUM_KERNELS ((int)(sizeof(simd_kernels) / sizeof(simd_kernels[0])))
+
+static int cpu_supports(const char *name)
+{
+#if HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (strcmp(name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+int simd_init(const char *max_isa)
+{
+    int i = 0;
+
+    /* Start the search at the requested cap, if any */
+    if (max_isa) {
+        while (i < NUM_KERNELS && strcmp(simd_kernels[i].name, max_isa) != 0) i++;
+        if (i == NUM_KERNELS) {
+            if (!life_quiet) printf("Unknown or unavailable instruction set: %s\n", max_isa);
+            return -1;
+        }
+    }
+
+    for (; i < NUM_KERNELS; i++) {
+        if (cpu_supports(simd_kernels[i].name)) {
+            simd_row = simd_kernels[i].kernel;
+            simd_isa_name = simd_kernels[i].name;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *simd_isa(void)
+{
+    return simd_isa_name;
+}
+
+long scalar_band(Grid *dst, const Grid *src, int y0, int y1)
+{
+    long count = 0;
+
+    for (int y = y0; y < y1; y++)
+        count += scalar_row(GRID_ROW(dst, y), GRID_ROW(src, y - 1), GRID_ROW(src, y),
+                            GRID_ROW(src, y + 1), src->width);
+    return count;
+}
+
+long simd_band(Grid *dst, const Grid *src, int y0, int y1)
+{
+    long count = 0;
+
+    for (int y = y0; y < y1; y++)
+        count += simd_row(GRID_ROW(dst, y), GRID_ROW(src, y - 1), GRID_ROW(src, y),
+                          GRID_ROW(src, y + 1), src->width);
+    return count;
+}
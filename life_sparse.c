@@ -0,0 +1,222 @@
+/*
+ * Sparse engine: only the live cells are stored.
+ *
+ * The world is a sorted array of live cell keys, (x << 32) | y: runs of
+ * rows, one run per column, in the order final_world000.txt is written.
+ * A generation walks the columns that have a live cell next to them and
+ * counts neighbors by merging the runs of the three columns around each,
+ * so it writes the next generation already sorted. Memory and time go
+ * with the number of live cells, not with the area of the world.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "life.h"
+
+static uint64_t cell_key(int x, int y)
+{
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+    uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+    return (ka > kb) - (ka < kb);
+}
+
+int sparse_alloc(SparseWorld *sw, int X, int Y)
+{
+    memset(sw, 0, sizeof(*sw));
+    sw->w_X = X;
+    sw->w_Y = Y;
+    return 0;
+}
+
+void sparse_free(SparseWorld *sw)
+{
+    free(sw->live);
+    free(sw->next);
+    memset(sw, 0, sizeof(*sw));
+}
+
+static int reserve_live(SparseWorld *sw, size_t n)
+{
+    uint64_t *p;
+    size_t cap = sw->live_cap ? sw->live_cap : 1024;
+
+    if (n <= sw->live_cap) return 0;
+    while (cap < n) cap *= 2;
+    p = (uint64_t *)realloc(sw->live, cap * sizeof(uint64_t));
+    if (!p) return -1;
+    sw->live = p;
+    sw->live_cap = cap;
+    return 0;
+}
+
+/* Sort the live cells and drop repeats, after sparse_add() */
+static void normalize(SparseWorld *sw)
+{
+    size_t n = 0;
+
+    if (sw->sorted) return;
+    sw->sorted = 1;
+    if (sw->count < 2) return;     /* live is NULL with no cells */
+    qsort(sw->live, sw->count, sizeof(uint64_t), compare_keys);
+    for (size_t i = 0; i < sw->count; i++) {
+        if (n == 0 || sw->live[n - 1] != sw->live[i]) sw->live[n++] = sw->live[i];
+    }
+    sw->count = n;
+}
+
+int sparse_add(SparseWorld *sw, int x, int y)
+{
+    if (reserve_live(sw, sw->count + 1) != 0) return -1;
+    sw->live[sw->count++] = cell_key(x, y);
+    sw->sorted = 0;
+    return 0;
+}
+
+static int key_x(uint64_t key) { return (int)(key >> 32); }
+static long key_y(uint64_t key) { return (long)(uint32_t)key; }
+
+/* Append a cell of the next generation */
+static int emit(SparseWorld *sw, uint64_t key)
+{
+    if (sw->next_count == sw->next_cap) {
+        size_t cap = sw->next_cap ? 2 * sw->next_cap : 1024;
+        uint64_t *p = (uint64_t *)realloc(sw->next, cap * sizeof(uint64_t));
+        if (!p) return -1;
+        sw->next = p;
+        sw->next_cap = cap;
+    }
+    sw->next[sw->next_count++] = key;
+    return 0;
+}
+
+/*
+ * Next generation of column c, from the live cells of columns c-1, c and
+ * c+1, which are [b[k], e[k]). The rows that can be alive next are the
+ * ones within a row of a live cell; they come out of a merge of the three
+ * columns in increasing order, and for each one a window of rows y-1..y+1
+ * slides down every column to count its neighbors.
+ */
+static int step_column(SparseWorld *sw, int c, const uint64_t *b[3], const uint64_t *e[3])
+{
+    const uint64_t *m[3], *win[3];
+    long last = -1;     /* last row done */
+
+    for (int k = 0; k < 3; k++) m[k] = win[k] = b[k];
+
+    for (;;) {
+        int k = -1;
+        long yy;
+
+        for (int i = 0; i < 3; i++) {
+            if (m[i] < e[i] && (k < 0 || key_y(*m[i]) < key_y(*m[k]))) k = i;
+        }
+        if (k < 0) return 0;
+        yy = key_y(*m[k]++);
+
+        for (long y = yy - 1 > last ? yy - 1 : last + 1; y <= yy + 1 && y < sw->w_Y; y++) {
+            int count = 0, alive = 0;
+
+            if (y < 0) continue;
+            for (int i = 0; i < 3; i++) {
+                while (win[i] < e[i] && key_y(*win[i]) < y - 1) win[i]++;
+                for (const uint64_t *t = win[i]; t < e[i] && key_y(*t) <= y + 1; t++) {
+                    if (i == 1 && key_y(*t) == y) alive = 1;
+                    else count++;
+                }
+            }
+            if ((count == 3 || (count == 2 && alive)) && emit(sw, cell_key(c, (int)y)) != 0)
+                return -1;
+            last = y;
+        }
+    }
+}
+
+long sparse_step(SparseWorld *sw)
+{
+    const uint64_t *end, *pos, *q;
+    long done = -1;     /* last column done */
+    uint64_t *t;
+    size_t cap;
+
+    normalize(sw);
+    end = sw->live + sw->count;
+    pos = sw->live;     /* first cell in column c-1 or later */
+    sw->next_count = 0;
+
+    /* Columns next to a live cell, in increasing order, so the next
+       generation comes out sorted */
+    for (q = sw->live; q < end; ) {
+        int x = key_x(*q);
+
+        for (long c = x - 1 > done ? x - 1 : done + 1; c <= x + 1 && c < sw->w_X; c++) {
+            const uint64_t *b[3], *e[3], *p;
+
+            if (c < 0) continue;
+            while (pos < end && key_x(*pos) < c - 1) pos++;
+
+            /* Runs of columns c-1, c and c+1, any of them possibly empty */
+            p = pos;
+            for (int k = 0; k < 3; k++) {
+                b[k] = p;
+                while (p < end && key_x(*p) == c - 1 + k) p++;
+                e[k] = p;
+            }
+            if (step_column(sw, (int)c, b, e) != 0) return -1;
+            done = c;
+        }
+        while (q < end && key_x(*q) == x) q++;
+    }
+
+    t = sw->live;
+    sw->live = sw->next;
+    sw->next = t;
+    cap = sw->live_cap;
+    sw->live_cap = sw->next_cap;
+    sw->next_cap = cap;
+    sw->count = sw->next_count;
+    sw->sorted = 1;
+    return (long)sw->count;
+}
+
+long sparse_count(SparseWorld *sw)
+{
+    normalize(sw);
+    return (long)sw->count;
+}
+
+int sparse_get(SparseWorld *sw, int x, int y)
+{
+    uint64_t key = cell_key(x, y);
+
+    normalize(sw);
+    if (sw->count == 0) return 0;
+    return bsearch(&key, sw->live, sw->count, sizeof(uint64_t), compare_keys) != NULL;
+}
+
+/* One line per column x, one character per row y, as the drivers write
+   final_world000.txt; a line at a time from the sorted cells */
+int sparse_write(SparseWorld *sw, FILE *fd)
+{
+    char *line = (char *)malloc((size_t)sw->w_Y + 1);
+    size_t i = 0;
+
+    if (!line) return -1;
+    normalize(sw);
+    line[sw->w_Y] = '\n';
+
+    for (int x = 0; x < sw->w_X; x++) {
+        memset(line, '0', sw->w_Y);
+        for (; i < sw->count && (int)(sw->live[i] >> 32) == x; i++)
+            line[(uint32_t)sw->live[i]] = '1';
+        fwrite(line, 1, (size_t)sw->w_Y + 1, fd);
+    }
+
+    free(line);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Temporally tiled update: advance the world several generations per pass
+ * over memory.
+ *
+ * The world is cut into tile_w x tile_h cores. Each core is copied into a
+ * scratch grid together with a margin of k cells (overlapped halo), and
+ * the scratch is advanced k generations while it sits in cache. Cells near
+ * the edge of the scratch go wrong one cell per generation because they
+ * do not see their real neighbors, so the area that is computed shrinks
+ * by one cell per generation and after k of them exactly the core is left.
+ * Where the margin is cut off by the edge of the world the scratch border
+ * is the world's own zero border, so nothing shrinks there.
+ *
+ * Tiles are wider than they are tall by default: a tile row is a single
+ * memcpy, while every extra row of a tile is another page to look up.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "life.h"
+
+/* Zero the border around the first rows x cols cells of g */
+static void clear_border(Grid *g, int rows, int cols)
+{
+    memset(GRID_ROW(g, -1) - HALO, 0, (size_t)cols + 2 * HALO);
+    memset(GRID_ROW(g, rows) - HALO, 0, (size_t)cols + 2 * HALO);
+    for (int y = 0; y < rows; y++) {
+        CELL(g, y, -1) = 0;
+        CELL(g, y, cols) = 0;
+    }
+}
+
+static int min_int(int a, int b) { return a < b ? a : b; }
+static int max_int(int a, int b) { return a > b ? a : b; }
+
+/* Scratch pair kept from one call to the next, so its pages are only
+   faulted in once; it is regrown when a call needs a bigger one */
+static Grid scratch[2];
+
+static int get_scratch(int width, int height)
+{
+    if (scratch[0].cells && width <= scratch[0].width && height <= scratch[0].height)
+        return 0;
+
+    grid_free(&scratch[0]);
+    grid_free(&scratch[1]);
+    if (grid_alloc(&scratch[0], width, height) != 0) return -1;
+    if (grid_alloc(&scratch[1], width, height) != 0) {
+        grid_free(&scratch[0]);
+        return -1;
+    }
+    return 0;
+}
+
+int tiled_step(Grid *dst, const Grid *src, int k, int tile_w, int tile_h,
+               long *counts)
+{
+    int H = src->height, W = src->width;
+
+    if (k < 1) return 0;
+    if (get_scratch(min_int(tile_w, W) + 2 * k, min_int(tile_h, H) + 2 * k) != 0)
+        return -1;
+
+    for (int g = 0; g < k; g++) counts[g] = 0;
+
+    for (int ty0 = 0; ty0 < H; ty0 += tile_h) {
+        int ty1 = min_int(ty0 + tile_h, H);
+        int ry0 = max_int(ty0 - k, 0), ry1 = min_int(ty1 + k, H);
+
+        for (int tx0 = 0; tx0 < W; tx0 += tile_w) {
+            int tx1 = min_int(tx0 + tile_w, W);
+            int rx0 = max_int(tx0 - k, 0), rx1 = min_int(tx1 + k, W);
+            int rows = ry1 - ry0, cols = rx1 - rx0;
+            Grid *cur = &scratch[0], *next = &scratch[1];
+
+            /* Load core plus margin; scratch (0, 0) is world (ry0, rx0) */
+            clear_border(cur, rows, cols);
+            clear_border(next, rows, cols);
+            for (int y = 0; y < rows; y++)
+                memcpy(GRID_ROW(cur, y), GRID_ROW(src, ry0 + y) + rx0, cols);
+
+            for (int g = 0; g < k; g++) {
+                /* Cells still needed after this generation: the core plus
+                   what later generations read, clipped to the world */
+                int m = k - 1 - g;
+                int ny0 = max_int(ty0 - m, 0) - ry0, ny1 = min_int(ty1 + m, H) - ry0;
+                int nx0 = max_int(tx0 - m, 0) - rx0, nx1 = min_int(tx1 + m, W) - rx0;
+                int cy0 = ty0 - ry0, cy1 = ty1 - ry0;
+                int cx0 = tx0 - rx0, cx1 = tx1 - rx0;
+                Grid *t;
+
+                for (int y = ny0; y < ny1; y++) {
+                    char *out = GRID_ROW(next, y);
+                    const char *up = GRID_ROW(cur, y - 1);
+                    const char *mid = GRID_ROW(cur, y);
+                    const char *dn = GRID_ROW(cur, y + 1);
+
+                    long row = simd_row(out + nx0, up + nx0, mid + nx0, dn + nx0,
+                                        nx1 - nx0);
+
+                    /* Only the core counts; the margins are a few cells, so
+                       take them back out rather than split the kernel call */
+                    if (y >= cy0 && y < cy1) {
+                        for (int x = nx0; x < cx0; x++) row -= out[x];
+                        for (int x = cx1; x < nx1; x++) row -= out[x];
+                        counts[g] += row;
+                    }
+                }
+
+                t = cur;
+                cur = next;
+                next = t;
+            }
+
+            for (int y = ty0; y < ty1; y++)
+                memcpy(GRID_ROW(dst, y) + tx0, GRID_ROW(cur, y - ry0) + (tx0 - rx0),
+                       tx1 - tx0);
+        }
+    }
+
+    return 0;
+}
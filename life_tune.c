@@ -0,0 +1,206 @@
+/*
+ * Machine profile: --tune times the grid engines on a synthetic world and
+ * writes how long each takes per cell and generation; the drivers read the
+ * profile at startup and, unless --engine says otherwise, run the fastest
+ * engine they have.
+ *
+ * The profile is a text file of "name value" lines, '#' starting a
+ * comment:
+ *
+ *     simd 0.082
+ *     tiled 0.061 1024x256
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "life.h"
+
+#define TUNE_SIZE 2048      /* synthetic world is TUNE_SIZE x TUNE_SIZE */
+#define TUNE_GENS 16        /* generations timed per engine, after one warm-up */
+
+static const int tile_sizes[][2] = {
+    { 256, 256 }, { 1024, 64 }, { 1024, 256 }, { 4096, 64 }
+};
+
+#define NUM_TILE_SIZES ((int)(sizeof(tile_sizes) / sizeof(tile_sizes[0])))
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The same random world, about a third alive, every time */
+static void random_world(Grid *g)
+{
+    unsigned long long r = 12345;
+
+    for (int y = 0; y < g->height; y++) {
+        char *row = GRID_ROW(g, y);
+        for (int x = 0; x < g->width; x++) {
+            r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+            row[x] = (char)((r >> 33) % 3 == 0);
+        }
+    }
+}
+
+/* ns per cell and generation of a band kernel over the whole world */
+static double time_band(BandKernel band, Grid *a, Grid *b)
+{
+    double start;
+
+    random_world(a);
+    band(b, a, 0, a->height);
+    start = now();
+    for (int i = 0; i < TUNE_GENS; i++) {
+        Grid *t = a;
+        band(b, a, 0, a->height);
+        a = b;
+        b = t;
+    }
+    return (now() - start) * 1e9 / TUNE_GENS / ((double)a->width * a->height);
+}
+
+static double time_bitpack(Grid *a)
+{
+    BitWorld bw;
+    double start;
+
+    random_world(a);
+    if (bitworld_alloc(&bw, a->width, a->height) != 0) return -1;
+    bitworld_load(&bw, GRID_ROW(a, 0), a->stride);
+    bitworld_step(&bw, 0, a->height);
+    bitworld_swap(&bw);
+    start = now();
+    for (int i = 0; i < TUNE_GENS; i++) {
+        bitworld_step(&bw, 0, a->height);
+        bitworld_swap(&bw);
+    }
+    start = now() - start;
+    bitworld_free(&bw);
+    return start * 1e9 / TUNE_GENS / ((double)a->width * a->height);
+}
+
+static double time_tiled(Grid *a, Grid *b, int tile_w, int tile_h)
+{
+    long counts[TUNE_GENS];
+    double start;
+
+    random_world(a);
+    if (tiled_step(b, a, 1, tile_w, tile_h, counts) != 0) return -1;
+    start = now();
+    if (tiled_step(b, a, TUNE_GENS, tile_w, tile_h, counts) != 0) return -1;
+    return (now() - start) * 1e9 / TUNE_GENS / ((double)a->width * a->height);
+}
+
+int life_tune(const char *file)
+{
+    Grid a, b;
+    FILE *fd;
+    double t, best_tiled = -1;
+    int best_tile = 0;
+
+    if ((fd = fopen(file, "w")) == NULL) {
+        printf("Can't open file %s\n", file);
+        return -1;
+    }
+    if (grid_alloc(&a, TUNE_SIZE, TUNE_SIZE) != 0) {
+        printf("Error: Failed to allocate memory for the tuning world\n");
+        fclose(fd);
+        return -1;
+    }
+    if (grid_alloc(&b, TUNE_SIZE, TUNE_SIZE) != 0) {
+        printf("Error: Failed to allocate memory for the tuning world\n");
+        grid_free(&a);
+        fclose(fd);
+        return -1;
+    }
+    simd_init(NULL);
+    lut_init();
+
+    printf("Timing the engines on a random %d x %d world (ns per cell and generation)\n",
+           TUNE_SIZE, TUNE_SIZE);
+    fprintf(fd, "# Written by --tune: ns per cell and generation on a random %d x %d world\n",
+            TUNE_SIZE, TUNE_SIZE);
+
+    t = time_band(scalar_band, &a, &b);
+    printf("  byte      %.3f\n", t);
+    fprintf(fd, "byte %.4f\n", t);
+
+    t = time_band(simd_band, &a, &b);
+    printf("  simd      %.3f (%s)\n", t, simd_isa());
+    fprintf(fd, "simd %.4f\n", t);
+
+    t = time_band(lut_band, &a, &b);
+    printf("  lut       %.3f\n", t);
+    fprintf(fd, "lut %.4f\n", t);
+
+    t = time_band(box_band, &a, &b);
+    printf("  box       %.3f\n", t);
+    fprintf(fd, "box %.4f\n", t);
+
+    t = time_bitpack(&a);
+    if (t >= 0) {
+        printf("  bitpack   %.3f\n", t);
+        fprintf(fd, "bitpack %.4f\n", t);
+    }
+
+    for (int i = 0; i < NUM_TILE_SIZES; i++) {
+        t = time_tiled(&a, &b, tile_sizes[i][0], tile_sizes[i][1]);
+        if (t < 0) continue;
+        printf("  tiled     %.3f (%dx%d)\n", t, tile_sizes[i][0], tile_sizes[i][1]);
+        if (best_tiled < 0 || t < best_tiled) {
+            best_tiled = t;
+            best_tile = i;
+        }
+    }
+    if (best_tiled >= 0)
+        fprintf(fd, "tiled %.4f %dx%d\n", best_tiled, tile_sizes[best_tile][0],
+                tile_sizes[best_tile][1]);
+
+    fclose(fd);
+    grid_free(&a);
+    grid_free(&b);
+    printf("Wrote %s\n", file);
+    return 0;
+}
+
+void life_apply_profile(LifeOptions *opts, unsigned supported)
+{
+    char line[128], name[32];
+    double best = -1, t;
+    int tile_w = 0, tile_h = 0;
+    FILE *fd;
+
+    if (opts->engine_set || (fd = fopen(opts->profile, "r")) == NULL) return;
+    if (opts->active) supported &= ENGINE_BIT(ENGINE_BYTE) | ENGINE_BIT(ENGINE_SIMD);
+
+    while (fgets(line, sizeof(line), fd)) {
+        int tw = 0, th = 0;
+
+        if (sscanf(line, "%31s %lf %dx%d", name, &t, &tw, &th) < 2 || name[0] == '#') continue;
+        for (int e = 0; e <= ENGINE_BOX; e++) {
+            if (strcmp(name, engine_name((Engine)e)) != 0 || !(supported & ENGINE_BIT(e)))
+                continue;
+            if (best < 0 || t < best) {
+                best = t;
+                opts->engine = (Engine)e;
+                tile_w = tw;
+                tile_h = th;
+            }
+        }
+    }
+    fclose(fd);
+
+    if (best < 0) return;
+    if (opts->engine == ENGINE_TILED && !opts->tile_set && tile_w > 0 && tile_h > 0) {
+        opts->tile_w = tile_w;
+        opts->tile_h = tile_h;
+    }
+    if (!life_quiet) printf("Using the %s engine, the fastest in %s\n",
+                            engine_name(opts->engine), opts->profile);
+}
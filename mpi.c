@@ -3,125 +3,107 @@
 #include <mpi.h>
 #include <string.h>
 
+#include "life.h"
+
 #ifdef NOOUTPUTFILE
 #define NOOUTPUTFILE 1
 #else
 #define NOOUTPUTFILE 0
 #endif
 
-#define MAX_N 8192
-
 #ifndef DEBUG_LEVEL
 #define DEBUG_LEVEL 0
 #endif
 
-char w[MAX_N][MAX_N];
-char neww[MAX_N][MAX_N];
+/* This rank's block plus its ghost cells, index through CELL(): rows and
+   columns -depth to local_w + depth - 1, the outermost being the zero
+   border of the allocation. Each rank only allocates its own block. The
+   third grid keeps the start of a run of generations, and is only needed
+   with deep ghost cells. */
+Grid grids[3];      /* allocations */
+Grid views[3];      /* the same, inset so cell (0, 0) is the block's first */
+Grid *w = &views[0];
 
 int w_X, w_Y;
+Cart cart;      /* how the world is split between the ranks */
 
+/* No rank holds the whole world, so init() and test_init() only set its
+   size; main() lays out each rank's block of the pattern once it is split */
 void init(int X, int Y)
 {
-    int i, j;
     w_X = X,  w_Y = Y;
-    for (i=0; i<w_X;i++)
-        for (j=0; j<w_Y; j++)
-            w[j][i] = 0;
-
-    for (i=0; i<w_X && i < w_Y; i++) w[i][i] = 1;
-    for (i=0; i<w_Y && i < w_X; i++) w[w_Y - 1 - i][i] = 1;
 }
 
 void test_init()
 {
     printf("Test on a small 4x6 world\n");
-    int i, j;
     w_X = 4;
     w_Y = 6;
-
-    for (i=0; i<w_X;i++)
-        for (j=0; j<w_Y; j++)
-            w[j][i] = 0;
-    w[0][3] = 1;
-    w[1][3] = 1;
-    w[2][1] = 1;
-    w[3][0] = w[3][1] = w[3][2] = w[4][1] = w[5][1] = 1;
 }
 
+/* Print this rank's block */
 void print_world()
 {
     int i, j;
 
-    for (i=0; i<w_Y; i++) {
-        for (j=0; j<w_X; j++) {
-            printf("%d", (int)w[i][j]);
+    for (i=0; i<w->height; i++) {
+        for (j=0; j<w->width; j++) {
+            printf("%d", (int)CELL(w, i, j));
         }
         printf("\n");
     }
 }
 
-int neighborcount(int x, int y)
+int main(int argc, char *argv[])
 {
-    int count = 0;
+    int rank;
+    int local_w_X, local_w_Y;
+    int iter = 0;
+    int grid_count;
+    long local_count, global_count, init_count;
+    long counts[GHOST_MAX_DEPTH], totals[GHOST_MAX_DEPTH];
+    MPI_Request exchange[3][16];    /* of each grid, persistent */
+    int req_count = 0;
+    LifeOptions opts;
+    BandKernel band = NULL;
+    unsigned engines = ENGINE_BIT(ENGINE_BYTE) | ENGINE_BIT(ENGINE_SIMD) | ENGINE_BIT(ENGINE_LUT) |
+                       ENGINE_BIT(ENGINE_BOX);
+    int engine, provided, total_threads;
+    char pages[128], host[MPI_MAX_PROCESSOR_NAME];
+    int host_len;
+
+    /* Initialize MPI; the threads of a rank never call it */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-    if ((x<0) || (x >=w_X)) {
-        printf("neighborcount: (%d %d) out of bound (0..%d, 0..%d).\n", x,y,
-           w_X, w_Y);
+    /* Every rank parses the options, rank 0 says what is wrong with them */
+    life_quiet = rank != 0;
+    if (life_parse_options(&argc, argv, &opts) != 0) {
+        MPI_Finalize();
         exit(0);
     }
-    if ((y<0) || (y >=w_Y)) {
-        printf("neighborcount: (%d %d) out of bound (0..%d, 0..%d).\n", x,y,
-           w_X, w_Y);
+
+    /* One rank times the engines, so the others do not compete with it */
+    if (opts.tune) {
+        if (rank == 0) life_tune(opts.profile);
+        MPI_Finalize();
         exit(0);
     }
 
-    if (x==0) {
-        if (y == 0) {
-            count = w[y][x+1] + w[y+1][x] + w[y+1][x+1];
-        } else if (y == w_Y-1) {
-            count = w[y][x+1] + w[y-1][x] + w[y-1][x+1];
-        } else {
-            count = w[y-1][x] + w[y+1][x] + w[y-1][x+1] + w[y][x+1] + w[y+1][x+1];
-        }
-    } else if (x == w_X -1) {
-        if (y == 0) {
-            count = w[y][x-1] + w[y+1][x-1] + w[y+1][x];
-        } else if (y == w_Y-1) {
-            count = w[y][x-1] + w[y-1][x] + w[y-1][x-1];
-        } else {
-            count = w[y-1][x] + w[y+1][x] + w[y-1][x-1] + w[y][x-1] + w[y+1][x-1];
-        }
-    } else { /* x is in the middle */
-        if (y == 0) {
-            count = w[y][x-1] + w[y][x+1] + w[y+1][x-1] + w[y+1][x] + w[y+1][x+1];
-        } else if (y == w_Y-1) {
-            count = w[y][x-1] + w[y][x+1] + w[y-1][x-1] + w[y-1][x] + w[y-1][x+1];
-        } else {
-            count = w[y-1][x-1] + w[y][x-1] + w[y+1][x-1] + w[y-1][x] + w[y+1][x]
-                    + w[y-1][x+1] + w[y][x+1] + w[y+1][x+1];
-        }
+    /* Rank 0 reads the machine profile and every rank runs its choice */
+    if (rank == 0) life_apply_profile(&opts, engines);
+    engine = (int)opts.engine;
+    MPI_Bcast(&engine, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    opts.engine = (Engine)engine;
+    if (life_check_engine(&opts, engines) != 0) {
+        MPI_Finalize();
+        exit(0);
     }
 
-    return count;
-}
-
-int main(int argc, char *argv[])
-{
-    int rank, size;
-    int local_w_Y, start_row;
-    int iter = 0;
-    int c, local_count, global_count, init_count;
-    MPI_Request requests[4];
-    MPI_Status statuses[4];
-
-    /* Initialize MPI */
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
-
     if (argc == 1) {
         if (rank == 0) {
-            printf("Usage: mpirun -np <num_processes> ./mpi <w_X> <w_Y>\n");
+            printf("Usage: mpirun -np <num_processes> ./mpi <w_X> <w_Y> [options]\n");
+            life_print_options();
         }
         MPI_Finalize();
         exit(0);
@@ -131,194 +113,138 @@ int main(int argc, char *argv[])
         init(atoi(argv[1]), atoi(argv[2]));
 
 
-    /* Calculate local grid division */
-    local_w_Y = w_Y / size;
-    /* Assign remainder rows */
-    if (rank < (w_Y % size))
-        local_w_Y++;
+    /* Printing every generation needs the world after every generation */
+    if (DEBUG_LEVEL > 10) opts.ghost = 1;
 
-    start_row = 0;
-    for (int i = 0; i < rank; i++) {
-        start_row += w_Y / size;
-        if (i < (w_Y % size))
-            start_row++;
+    /* Split the world into blocks of rows and columns, one per rank. The
+       Cartesian communicator may renumber the ranks. */
+    cart_init(&cart, w_X, w_Y, opts.ghost);
+    rank = cart.rank;
+    local_w_X = cart.local_w_X;
+    local_w_Y = cart.local_w_Y;
+    if (rank == 0) {
+        printf("Ranks in %d rows by %d columns of blocks\n", cart.dims[0], cart.dims[1]);
+        if (cart.depth < opts.ghost)
+            printf("Ghost cells only %d deep, as deep as the smallest block\n", cart.depth);
+    }
+
+    /* Threads within each rank, which may differ between ranks */
+    cart.threads = cart_threads(opts.threads, provided);
+    MPI_Reduce(&cart.threads, &total_threads, 1, MPI_INT, MPI_SUM, 0, cart.comm);
+    if (rank == 0) {
+        if (opts.threads > 1 && provided < MPI_THREAD_FUNNELED)
+            printf("No thread support in this MPI, one thread per rank\n");
+        if (total_threads > cart.size)
+            printf("%d threads over %d ranks\n", total_threads, cart.size);
     }
 
-    /* Initialize local grid */
-    for (int i = 0; i < w_X; i++) {
-        for (int j = 0; j < local_w_Y + 2; j++) {
-            w[j][i] = 0;
+    /* Only this rank's block and its ghost cells are allocated, zeroed */
+    grid_count = cart.depth > 1 ? 3 : 2;
+    for (int i = 0; i < grid_count; i++) {
+        if (grid_alloc(&grids[i], local_w_X + 2 * (cart.depth - 1),
+                       local_w_Y + 2 * (cart.depth - 1)) != 0) {
+            printf("Error: Failed to allocate memory for local grid on process %d\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        views[i] = grid_inset(&grids[i], cart.depth - 1);
     }
 
-    /* Initialize the grid with pattern */
+    /* The halo exchange of each grid is set up once, as the generations
+       take turns in them, and only restarted after that */
+    for (int i = 0; i < grid_count; i++)
+        req_count = cart_exchange_init(&cart, &views[i], exchange[i]);
+
+    /* Every rank says which pages it got, since the nodes may differ */
+    if (grid_describe_pages(&grids[0], pages, sizeof(pages)) == 0) {
+        MPI_Get_processor_name(host, &host_len);
+        printf("Rank %d on %s: local grids on %s\n", rank, host, pages);
+    }
+
+    /* Initialize the grid with pattern, the cells in this rank's block */
     if (argc == 2) {
         /* Test initialization */
-        if (0 >= start_row && 0 < start_row + local_w_Y) w[(0 - start_row) + 1][3] = 1;
-        if (1 >= start_row && 1 < start_row + local_w_Y) w[(1 - start_row) + 1][3] = 1;
-        if (2 >= start_row && 2 < start_row + local_w_Y) w[(2 - start_row) + 1][1] = 1;
-        if (3 >= start_row && 3 < start_row + local_w_Y) {
-            w[(3 - start_row) + 1][0] = 1;
-            w[(3 - start_row) + 1][1] = 1;
-            w[(3 - start_row) + 1][2] = 1;
-        }
-        if (4 >= start_row && 4 < start_row + local_w_Y) w[(4 - start_row) + 1][1] = 1;
-        if (5 >= start_row && 5 < start_row + local_w_Y) w[(5 - start_row) + 1][1] = 1;
+        cart_set(&cart, w, 0, 3);
+        cart_set(&cart, w, 1, 3);
+        cart_set(&cart, w, 2, 1);
+        cart_set(&cart, w, 3, 0);
+        cart_set(&cart, w, 3, 1);
+        cart_set(&cart, w, 3, 2);
+        cart_set(&cart, w, 4, 1);
+        cart_set(&cart, w, 5, 1);
     } else {
-        for (int i = 0; i < w_X && i < w_Y; i++) {
-            if (i >= start_row && i < start_row + local_w_Y) {
-                w[(i - start_row) + 1][i] = 1;
-            }
-        }
-        for (int i = 0; i < w_Y && i < w_X; i++) {
-            int j = w_Y - 1 - i;
-            if (j >= start_row && j < start_row + local_w_Y) {
-                w[(j - start_row) + 1][i] = 1;
-            }
-        }
+        for (int i = 0; i < w_X && i < w_Y; i++) cart_set(&cart, w, i, i);
+        for (int i = 0; i < w_Y && i < w_X; i++) cart_set(&cart, w, w_Y - 1 - i, i);
     }
 
     local_count = 0;
-    for (int x = 0; x < w_X; x++) {
-        for (int y = 1; y <= local_w_Y; y++) {
-            if (w[y][x] == 1) local_count++;
+    for (int x = 0; x < local_w_X; x++) {
+        for (int y = 0; y < local_w_Y; y++) {
+            if (CELL(w, y, x) == 1) local_count++;
         }
     }
 
     /* Sum up the global count */
-    MPI_Allreduce(&local_count, &init_count, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&local_count, &init_count, 1, MPI_LONG, MPI_SUM, cart.comm);
     global_count = init_count;
 
     if (rank == 0) {
-        printf("initial world, population count: %d\n", init_count);
+        printf("initial world, population count: %ld\n", init_count);
     }
     if (DEBUG_LEVEL > 10) print_world();
 
-    for (iter = 0; (iter < 200) && (global_count < 50 * init_count) &&
-         (global_count > init_count / 50); iter++) {
-
-        int req_count = 0;
-
-        /* Exchange rows */
-        /* I used AI here a little bit in the beginning to help me understand this process */
-        if (rank > 0) {
-            /* Receive top row from previous process */
-            MPI_Irecv(&w[0][0], w_X, MPI_CHAR, rank - 1, 0,
-                     MPI_COMM_WORLD, &requests[req_count++]);
-        }
-
-        if (rank < size - 1) {
-            /* Receive bottom row from next process */
-            MPI_Irecv(&w[local_w_Y + 1][0], w_X, MPI_CHAR, rank + 1, 1,
-                     MPI_COMM_WORLD, &requests[req_count++]);
-        }
-
-        if (rank > 0) {
-            /* Send top row to previous process */
-            MPI_Isend(&w[1][0], w_X, MPI_CHAR, rank - 1, 1,
-                     MPI_COMM_WORLD, &requests[req_count++]);
-        }
-
-        if (rank < size - 1) {
-            /* Send bottom row to next process */
-            MPI_Isend(&w[local_w_Y][0], w_X, MPI_CHAR, rank + 1, 0,
-                     MPI_COMM_WORLD, &requests[req_count++]);
-        }
-
-        /* Wait for row exchanges to complete */
-        MPI_Waitall(req_count, requests, statuses);
-
-        /* Update local grid */
-        for (int x = 0; x < w_X; x++) {
-            for (int y = 1; y <= local_w_Y; y++) {
-                int global_y = start_row + (y - 1);
-                c = neighborcount(x, y);  /* count neighbors */
-                if (c <= 1) neww[y][x] = 0;      /* die of loneliness */
-                else if (c >=4) neww[y][x] = 0;  /* die of overpopulation */
-                else if (c == 3)  neww[y][x] = 1;             /* becomes alive */
-                else neww[y][x] = w[y][x];   /* c == 2, no change */
-            }
+    if (opts.engine == ENGINE_SIMD) {
+        if (simd_init(opts.isa) != 0) {
+            MPI_Finalize();
+            exit(0);
         }
+        if (rank == 0) printf("Using the %s vector kernel\n", simd_isa());
+        band = simd_band;
+    } else if (opts.engine == ENGINE_LUT) {
+        lut_init();
+        band = lut_band;
+    } else if (opts.engine == ENGINE_BOX) {
+        band = box_band;
+    }
 
-        /* copy the world, and count the current lives */
-        local_count = 0;
-        for (int x = 0; x < w_X; x++) {
-            for (int y = 1; y <= local_w_Y; y++) {
-                w[y][x] = neww[y][x];
-                if (w[y][x] == 1) local_count++;
+    for (iter = 0; cart_keep_going(iter, global_count, init_count); ) {
+        /* Exchange depth edge rows, columns and corners with the eight
+           neighbors, then run up to depth generations before the next
+           exchange, the first one updating the interior while they travel.
+           One reduction sums the population of all of them. */
+        Grid *start = w;
+        MPI_Request *requests = exchange[start - views];
+        int n = cart.depth < 200 - iter ? cart.depth : 200 - iter;
+        int g;
+
+        MPI_Startall(req_count, requests);
+        w = cart_run(&cart, band, views, start, n, requests, req_count, counts);
+        MPI_Allreduce(counts, totals, n, MPI_LONG, MPI_SUM, cart.comm);
+
+        for (g = 0; g < n; g++) {
+            global_count = totals[g];
+            if (rank == 0) {
+                printf("iter = %d, population count = %ld\n", iter, global_count);
             }
+            iter++;
+            if (!cart_keep_going(iter, global_count, init_count)) break;
         }
 
-        /* Get global population count */
-        MPI_Allreduce(&local_count, &global_count, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-
-        if (rank == 0) {
-            printf("iter = %d, population count = %d\n", iter, global_count);
-        }
+        /* Stopped part way through: w ran ahead, so redo the run from its
+           start only up to the generation that was reached */
+        if (g + 1 < n) w = cart_run(&cart, band, views, start, g + 1, NULL, 0, counts);
     }
 
 
     if (NOOUTPUTFILE != 1) {
-        /* Gather all local grids to rank 0 */
-        char *global_w = NULL;
-        int *recvcounts = NULL;
-        int *displs = NULL;
-
-        if (rank == 0) {
-            global_w = (char *)malloc(w_X * w_Y * sizeof(char));
-            if (!global_w) {
-                printf("Error: Failed to allocate memory for global world\n");
-                MPI_Abort(MPI_COMM_WORLD, 1);
-            }
-
-            /* Initialize with zeros */
-            memset(global_w, 0, w_X * w_Y * sizeof(char));
-
-            recvcounts = (int *)malloc(size * sizeof(int));
-            displs = (int *)malloc(size * sizeof(int));
-
-            if (!recvcounts || !displs) {
-                printf("Error: Failed to allocate memory for gather parameters\n");
-                MPI_Abort(MPI_COMM_WORLD, 1);
-            }
-
-            int pos = 0;
-            for (int i = 0; i < size; i++) {
-                int i_local_w_Y = w_Y / size;
-                if (i < (w_Y % size))
-                    i_local_w_Y++;
-
-                recvcounts[i] = w_X * i_local_w_Y;
-                displs[i] = pos;
-                pos += recvcounts[i];
-            }
-        }
-
-
-        /* Transpose data from 2D array to 1D array for gathering */
-        char *local_data = (char *)malloc(w_X * local_w_Y * sizeof(char));
-        if (!local_data) {
-            printf("Error: Failed to allocate memory for local data on process %d\n", rank);
-            MPI_Abort(MPI_COMM_WORLD, 1);
-        }
-        /* I used previous notes from other classes for this */
-        for (int y = 0; y < local_w_Y; y++) {
-            memcpy(&local_data[y * w_X], &w[y + 1][0], w_X * sizeof(char));
-        }
-
-        /* Gather data to rank 0 */
-        MPI_Gatherv(local_data, w_X * local_w_Y, MPI_CHAR,
-                   global_w, recvcounts, displs, MPI_CHAR,
-                   0, MPI_COMM_WORLD);
-
-        free(local_data);
+        /* Gather all the blocks to rank 0 */
+        char *global_w = cart_gather(&cart, w);
 
         if (rank == 0) {
             FILE *fd;
             if ((fd = fopen("final_world000.txt", "w")) != NULL) {
                 for (int x = 0; x < w_X; x++) {
                     for (int y = 0; y < w_Y; y++) {
-                        fprintf(fd, "%d", (int)global_w[y * w_X + x]);
+                        fprintf(fd, "%d", (int)global_w[(size_t)y * w_X + x]);
                     }
                     fprintf(fd, "\n");
                 }
@@ -329,11 +255,15 @@ int main(int argc, char *argv[])
 
             /* Clean Up */
             free(global_w);
-            free(recvcounts);
-            free(displs);
         }
     }
 
+    for (int i = 0; i < grid_count; i++) {
+        for (int r = 0; r < req_count; r++) MPI_Request_free(&exchange[i][r]);
+        grid_free(&grids[i]);
+    }
+    cart_free(&cart);
+
     MPI_Finalize();
     return 0;
 }
\ No newline at end of file
@@ -17,136 +17,92 @@
 #include <mpi.h>
 #include <string.h>
 
+#include "life.h"
+
 #ifdef NOOUTPUTFILE
 #define NOOUTPUTFILE 1
 #else
 #define NOOUTPUTFILE 0
 #endif
 
-#define MAX_N 8192
-
 #ifndef DEBUG_LEVEL
 #define DEBUG_LEVEL 0
 #endif
 
-char local_w[MAX_N][MAX_N];  // Local world with ghost rows
-char neww[MAX_N][MAX_N];    // Next generation grid
+// Local world and next generation with their ghost cells, index through
+// CELL(): rows and columns -depth to local_w + depth - 1, the outermost in
+// the zero border of the allocation. Only this rank's block is allocated.
+// The third grid keeps the start of a run of generations, and is only
+// needed with deep ghost cells.
+Grid grids[3];      // allocations
+Grid views[3];      // the same, inset so cell (0, 0) is the block's first
+int grid_count;
+Grid *local_w = &views[0];
 
 int w_Y;  // Global variable to match sequential version
+Cart cart;  // How the world is split between the ranks
 
-// Initialize local portion of the world - EXACTLY matching sequential code
-void init_local_world(int w_X, int w_Y, int local_w_Y, int start_row)
+// Allocate the local grids, zeroed, for local_w_Y rows of local_w_X cells
+// and the ghost cells around them. Every rank says which pages it got,
+// since the nodes may be set up differently.
+void alloc_local_world(int local_w_X, int local_w_Y)
 {
-    int i, j;
+    char pages[128], host[MPI_MAX_PROCESSOR_NAME];
+    int host_len, extra = cart.depth - 1;
 
-    // Initialize local portion to 0 - exactly as sequential version does
-    for (i = 0; i < w_X; i++) {
-        for (j = 0; j < local_w_Y + 2; j++) {  // +2 for ghost rows
-            local_w[j][i] = 0;
-        }
-    }
-
-    // Exactly match sequential initialization pattern
-    // First diagonal (i == j)
-    for (i = 0; i < w_X && i < w_Y; i++) {
-        if (i >= start_row && i < start_row + local_w_Y) {
-            local_w[(i - start_row) + 1][i] = 1;  // +1 for ghost row offset
+    grid_count = cart.depth > 1 ? 3 : 2;
+    for (int i = 0; i < grid_count; i++) {
+        if (grid_alloc(&grids[i], local_w_X + 2 * extra, local_w_Y + 2 * extra) != 0) {
+            printf("Error: Failed to allocate memory for the local world\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        views[i] = grid_inset(&grids[i], extra);
     }
-
-    // Second diagonal (i == w_Y - 1 - j)
-    for (i = 0; i < w_Y && i < w_X; i++) {
-        int j = w_Y - 1 - i;  // This matches sequential code exactly
-        if (j >= start_row && j < start_row + local_w_Y) {
-            local_w[(j - start_row) + 1][i] = 1;  // +1 for ghost row offset
-        }
+    if (grid_describe_pages(&grids[0], pages, sizeof(pages)) == 0) {
+        MPI_Get_processor_name(host, &host_len);
+        printf("Rank %d on %s: local grids on %s\n", cart.rank, host, pages);
     }
 }
 
-// Initialize test pattern for the small 4x6 world
-void test_init_local_world(int local_w_Y, int start_row)
+// Initialize local portion of the world - EXACTLY matching sequential code
+void init_local_world(int w_X)
 {
-    int i, j;
-    int w_X = 4;
-    int w_Y = 6;
-
-    // Initialize local portion to 0
-    for (i = 0; i < w_X; i++) {
-        for (j = 0; j < local_w_Y + 2; j++) {
-            local_w[j][i] = 0;
-        }
-    }
-
-    // Set the specific pattern from sequential test_init()
-    // w[0][3] = 1;
-    if (0 >= start_row && 0 < start_row + local_w_Y) local_w[(0 - start_row) + 1][3] = 1;
+    int i;
 
-    // w[1][3] = 1;
-    if (1 >= start_row && 1 < start_row + local_w_Y) local_w[(1 - start_row) + 1][3] = 1;
-
-    // w[2][1] = 1;
-    if (2 >= start_row && 2 < start_row + local_w_Y) local_w[(2 - start_row) + 1][1] = 1;
-
-    // w[3][0] = w[3][1] = w[3][2] = 1;
-    if (3 >= start_row && 3 < start_row + local_w_Y) {
-        local_w[(3 - start_row) + 1][0] = 1;
-        local_w[(3 - start_row) + 1][1] = 1;
-        local_w[(3 - start_row) + 1][2] = 1;
-    }
+    alloc_local_world(cart.local_w_X, cart.local_w_Y);
 
-    // w[4][1] = 1;
-    if (4 >= start_row && 4 < start_row + local_w_Y) local_w[(4 - start_row) + 1][1] = 1;
+    // First diagonal (i == j)
+    for (i = 0; i < w_X && i < w_Y; i++) cart_set(&cart, local_w, i, i);
 
-    // w[5][1] = 1;
-    if (5 >= start_row && 5 < start_row + local_w_Y) local_w[(5 - start_row) + 1][1] = 1;
+    // Second diagonal (i == w_Y - 1 - j)
+    for (i = 0; i < w_Y && i < w_X; i++) cart_set(&cart, local_w, w_Y - 1 - i, i);
 }
 
-// Exchange ghost rows with neighboring processes using non-blocking communication
-void exchange_ghost_rows(int w_X, int local_w_Y, int rank, int size)
+// Initialize test pattern for the small 4x6 world
+void test_init_local_world()
 {
-    MPI_Request requests[4];
-    MPI_Status statuses[4];
-    int req_count = 0;
-
-    // Post all possible receives first (non-blocking)
-    if (rank > 0) {
-        // Receive top ghost row from previous process
-        MPI_Irecv(&local_w[0][0], w_X, MPI_CHAR, rank - 1, 0,
-                 MPI_COMM_WORLD, &requests[req_count++]);
-    }
-
-    if (rank < size - 1) {
-        // Receive bottom ghost row from next process
-        MPI_Irecv(&local_w[local_w_Y + 1][0], w_X, MPI_CHAR, rank + 1, 1,
-                 MPI_COMM_WORLD, &requests[req_count++]);
-    }
+    alloc_local_world(cart.local_w_X, cart.local_w_Y);
 
-    // Then post all sends (also non-blocking)
-    if (rank > 0) {
-        // Send top row to previous process
-        MPI_Isend(&local_w[1][0], w_X, MPI_CHAR, rank - 1, 1,
-                 MPI_COMM_WORLD, &requests[req_count++]);
-    }
-
-    if (rank < size - 1) {
-        // Send bottom row to next process
-        MPI_Isend(&local_w[local_w_Y][0], w_X, MPI_CHAR, rank + 1, 0,
-                 MPI_COMM_WORLD, &requests[req_count++]);
-    }
-
-    // Wait for all communications to complete before proceeding
-    MPI_Waitall(req_count, requests, statuses);
+    // Set the specific pattern from sequential test_init()
+    cart_set(&cart, local_w, 0, 3);     // w[0][3] = 1;
+    cart_set(&cart, local_w, 1, 3);     // w[1][3] = 1;
+    cart_set(&cart, local_w, 2, 1);     // w[2][1] = 1;
+    cart_set(&cart, local_w, 3, 0);     // w[3][0] = w[3][1] = w[3][2] = 1;
+    cart_set(&cart, local_w, 3, 1);
+    cart_set(&cart, local_w, 3, 2);
+    cart_set(&cart, local_w, 4, 1);     // w[4][1] = 1;
+    cart_set(&cart, local_w, 5, 1);     // w[5][1] = 1;
 }
 
 // Print local world for debugging
-void print_local_world(int w_X, int local_w_Y, int rank)
+void print_local_world(int local_w_X, int local_w_Y, int rank)
 {
     if (DEBUG_LEVEL <= 10) return;
 
     printf("Process %d local world:\n", rank);
-    for (int y = 1; y <= local_w_Y; y++) {
-        for (int x = 0; x < w_X; x++) {
-            printf("%d", (int)local_w[y][x]);
+    for (int y = 0; y < local_w_Y; y++) {
+        for (int x = 0; x < local_w_X; x++) {
+            printf("%d", (int)CELL(local_w, y, x));
         }
         printf("\n");
     }
@@ -157,72 +113,116 @@ int main(int argc, char *argv[])
 {
     int rank, size;
     int w_X;
-    int local_w_Y, start_row;
+    int local_w_X, local_w_Y;
     int iter = 0;
-    int c, local_count, global_count, init_count;
+    long counts[GHOST_MAX_DEPTH], totals[GHOST_MAX_DEPTH];
+    long local_count, global_count, init_count;
     double start_time, end_time;
-
-    // Initialize MPI
-    MPI_Init(&argc, &argv);
+    LifeOptions opts;
+    BandKernel band = NULL;
+    unsigned engines = ENGINE_BIT(ENGINE_BYTE) | ENGINE_BIT(ENGINE_SIMD) | ENGINE_BIT(ENGINE_LUT) |
+                       ENGINE_BIT(ENGINE_BOX);
+    int engine, provided, total_threads;
+
+    // Initialize MPI; only the master thread of a rank calls it
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
+    // Every rank parses the --options; only rank 0 reports bad ones
+    life_quiet = rank != 0;
+    if (life_parse_options(&argc, argv, &opts) != 0) {
+        MPI_Finalize();
+        return 1;
+    }
+
+    // --tune: time the engines on rank 0 alone and stop
+    if (opts.tune) {
+        if (rank == 0) life_tune(opts.profile);
+        MPI_Finalize();
+        return 0;
+    }
+
+    // Rank 0 reads the machine profile and every rank runs its choice
+    if (rank == 0) life_apply_profile(&opts, engines);
+    engine = (int)opts.engine;
+    MPI_Bcast(&engine, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    opts.engine = (Engine)engine;
+    if (life_check_engine(&opts, engines) != 0) {
+        MPI_Finalize();
+        return 1;
+    }
+
     // Parse command line arguments
     if (argc == 1) {
         if (rank == 0) {
-            printf("Usage: mpirun -np <num_processes> ./mpi <w_X> <w_Y>\n");
+            printf("Usage: mpirun -np <num_processes> ./mpi <w_X> <w_Y> [options]\n");
+            life_print_options();
         }
         MPI_Finalize();
         return 1;
-    } else if (argc == 2) {
+    }
+
+    if (argc == 2) {
         // Test init with small world
         w_X = 4;
         w_Y = 6;
+    } else {
+        // Normal initialization with dimensions from command line
+        w_X = atoi(argv[1]);
+        w_Y = atoi(argv[2]);
+    }
 
-        // Calculate local domain division
-        local_w_Y = w_Y / size;
-        // Handle remainder rows (assign to last process)
-        if (rank == size - 1) {
-            local_w_Y += w_Y % size;
-        }
-        start_row = rank * (w_Y / size);
+    // Printing every generation needs the world after every generation
+    if (DEBUG_LEVEL > 10) opts.ghost = 1;
 
+    // Split the world into blocks of rows and columns, one per rank; the
+    // Cartesian communicator may renumber the ranks
+    cart_init(&cart, w_X, w_Y, opts.ghost);
+    rank = cart.rank;
+    local_w_X = cart.local_w_X;
+    local_w_Y = cart.local_w_Y;
+    if (rank == 0) {
+        printf("Ranks in %d rows by %d columns of blocks\n", cart.dims[0], cart.dims[1]);
+        if (cart.depth < opts.ghost)
+            printf("Ghost cells only %d deep, as deep as the smallest block\n", cart.depth);
+    }
+
+    // Threads within each rank, which may differ between ranks
+    cart.threads = cart_threads(opts.threads, provided);
+    MPI_Reduce(&cart.threads, &total_threads, 1, MPI_INT, MPI_SUM, 0, cart.comm);
+    if (rank == 0) {
+        if (opts.threads > 1 && provided < MPI_THREAD_FUNNELED)
+            printf("No thread support in this MPI, one thread per rank\n");
+        if (total_threads > size)
+            printf("%d threads over %d ranks\n", total_threads, size);
+    }
+
+    if (argc == 2) {
         // Initialize the test pattern
         if (rank == 0 && DEBUG_LEVEL > 0) {
             printf("Test on a small 4x6 world\n");
         }
-        test_init_local_world(local_w_Y, start_row);
+        test_init_local_world();
     } else {
-        // Normal initialization with dimensions from command line
-        w_X = atoi(argv[1]);
-        w_Y = atoi(argv[2]);
-
-        // Calculate local domain division
-        local_w_Y = w_Y / size;
-        // Handle remainder rows (assign to last process)
-        if (rank == size - 1) {
-            local_w_Y += w_Y % size;
-        }
-        start_row = rank * (w_Y / size);
-
         // Initialize local world with normal pattern
-        init_local_world(w_X, w_Y, local_w_Y, start_row);
+        init_local_world(w_X);
     }
 
     // Count initial population in local domain
     local_count = 0;
-    for (int x = 0; x < w_X; x++) {
-        for (int y = 1; y <= local_w_Y; y++) {  // Skip ghost rows
-            if (local_w[y][x] == 1) local_count++;
+    for (int x = 0; x < local_w_X; x++) {
+        for (int y = 0; y < local_w_Y; y++) {  // Skip ghost cells
+            if (CELL(local_w, y, x) == 1) local_count++;
         }
     }
 
     // Get global population count
-    MPI_Allreduce(&local_count, &init_count, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&local_count, &init_count, 1, MPI_LONG, MPI_SUM, cart.comm);
     global_count = init_count;
 
     if (rank == 0) {
-        printf("initial world, population count: %d\n", init_count);
+        printf("initial world, population count: %ld\n", init_count);
     }
 
     if (DEBUG_LEVEL > 10) {
@@ -230,100 +230,79 @@ int main(int argc, char *argv[])
         for (int proc = 0; proc < size; proc++) {
             if (rank == proc) {
                 printf("Process %d initial local world:\n", rank);
-                for (int y = 1; y <= local_w_Y; y++) {
-                    for (int x = 0; x < w_X; x++) {
-                        printf("%d", (int)local_w[y][x]);
+                for (int y = 0; y < local_w_Y; y++) {
+                    for (int x = 0; x < local_w_X; x++) {
+                        printf("%d", (int)CELL(local_w, y, x));
                     }
                     printf("\n");
                 }
             }
-            MPI_Barrier(MPI_COMM_WORLD);
+            MPI_Barrier(cart.comm);
+        }
+    }
+
+    // Pick the kernel for the update; byte keeps the loop below
+    if (opts.engine == ENGINE_SIMD) {
+        if (simd_init(opts.isa) != 0) {
+            MPI_Finalize();
+            return 1;
         }
+        if (rank == 0) printf("Using the %s vector kernel\n", simd_isa());
+        band = simd_band;
+    } else if (opts.engine == ENGINE_LUT) {
+        lut_init();
+        band = lut_band;
+    } else if (opts.engine == ENGINE_BOX) {
+        band = box_band;
     }
 
     // Start timer
     start_time = MPI_Wtime();
 
     // Main simulation loop
-    for (iter = 0; (iter < 200) && (global_count < 50 * init_count) &&
-         (global_count > init_count / 50); iter++) {
-
-        // Exchange ghost rows with neighbors using non-blocking communication
-        exchange_ghost_rows(w_X, local_w_Y, rank, size);
-
-        // Update local domain
-        for (int x = 0; x < w_X; x++) {
-            for (int y = 1; y <= local_w_Y; y++) {  // Skip ghost rows
-                c = 0; // Initialize count to 0
-
-                // Directly implement neighbor counting to avoid bounds checking
-                int global_y = start_row + (y - 1);  // Convert to global coordinates
-
-                if (x == 0) {
-                    if (global_y == 0) {  // Top-left corner
-                        c = local_w[y][x+1] + local_w[y+1][x] + local_w[y+1][x+1];
-                    } else if (global_y == w_Y-1) {  // Bottom-left corner
-                        c = local_w[y][x+1] + local_w[y-1][x] + local_w[y-1][x+1];
-                    } else {  // Left edge (not corner)
-                        c = local_w[y-1][x] + local_w[y+1][x] + local_w[y-1][x+1] + local_w[y][x+1] + local_w[y+1][x+1];
-                    }
-                } else if (x == w_X-1) {
-                    if (global_y == 0) {  // Top-right corner
-                        c = local_w[y][x-1] + local_w[y+1][x-1] + local_w[y+1][x];
-                    } else if (global_y == w_Y-1) {  // Bottom-right corner
-                        c = local_w[y][x-1] + local_w[y-1][x] + local_w[y-1][x-1];
-                    } else {  // Right edge (not corner)
-                        c = local_w[y-1][x] + local_w[y+1][x] + local_w[y-1][x-1] + local_w[y][x-1] + local_w[y+1][x-1];
-                    }
-                } else {  // Not on left or right edge
-                    if (global_y == 0) {  // Top edge (not corner)
-                        c = local_w[y][x-1] + local_w[y][x+1] + local_w[y+1][x-1] + local_w[y+1][x] + local_w[y+1][x+1];
-                    } else if (global_y == w_Y-1) {  // Bottom edge (not corner)
-                        c = local_w[y][x-1] + local_w[y][x+1] + local_w[y-1][x-1] + local_w[y-1][x] + local_w[y-1][x+1];
-                    } else {  // Middle of grid
-                        c = local_w[y-1][x-1] + local_w[y][x-1] + local_w[y+1][x-1] + local_w[y-1][x] + local_w[y+1][x]
-                              + local_w[y-1][x+1] + local_w[y][x+1] + local_w[y+1][x+1];
-                    }
-                }
-
-                if (c <= 1) neww[y][x] = 0;      // die of loneliness
-                else if (c >= 4) neww[y][x] = 0;  // die of overpopulation
-                else if (c == 3) neww[y][x] = 1;  // becomes alive
-                else neww[y][x] = local_w[y][x];  // c == 2, no change
+    for (iter = 0; cart_keep_going(iter, global_count, init_count); ) {
+        MPI_Request requests[16];
+        Grid *start = local_w;
+        int n = cart.depth < 200 - iter ? cart.depth : 200 - iter;
+        int req_count, g;
+
+        // Send depth edge rows, columns and corners to the eight neighbors
+        // and run up to depth generations before the next exchange; the
+        // first updates the interior while they travel. One reduction sums
+        // the population of all of them.
+        req_count = cart_start_exchange(&cart, start, requests);
+        local_w = cart_run(&cart, band, views, start, n, requests, req_count, counts);
+        MPI_Allreduce(counts, totals, n, MPI_LONG, MPI_SUM, cart.comm);
+
+        for (g = 0; g < n; g++) {
+            global_count = totals[g];
+            if (rank == 0) {
+                printf("iter = %d, population count = %ld\n", iter, global_count);
             }
-        }
-
-        // Copy new world to current world and count population
-        local_count = 0;
-        for (int x = 0; x < w_X; x++) {
-            for (int y = 1; y <= local_w_Y; y++) {  // Skip ghost rows
-                local_w[y][x] = neww[y][x];
-                if (local_w[y][x] == 1) local_count++;
-            }
-        }
-
-        // Get global population count
-        MPI_Allreduce(&local_count, &global_count, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
 
-        if (rank == 0) {
-            printf("iter = %d, population count = %d\n", iter, global_count);
-        }
-
-        if (DEBUG_LEVEL > 10) {
-            // Print world after each iteration for debugging
-            for (int proc = 0; proc < size; proc++) {
-                if (rank == proc) {
-                    printf("Process %d after iteration %d:\n", rank, iter);
-                    for (int y = 1; y <= local_w_Y; y++) {
-                        for (int x = 0; x < w_X; x++) {
-                            printf("%d", (int)local_w[y][x]);
+            if (DEBUG_LEVEL > 10) {
+                // Print world after each iteration for debugging
+                for (int proc = 0; proc < size; proc++) {
+                    if (rank == proc) {
+                        printf("Process %d after iteration %d:\n", rank, iter);
+                        for (int y = 0; y < local_w_Y; y++) {
+                            for (int x = 0; x < local_w_X; x++) {
+                                printf("%d", (int)CELL(local_w, y, x));
+                            }
+                            printf("\n");
                         }
-                        printf("\n");
                     }
+                    MPI_Barrier(cart.comm);
                 }
-                MPI_Barrier(MPI_COMM_WORLD);
             }
+
+            iter++;
+            if (!cart_keep_going(iter, global_count, init_count)) break;
         }
+
+        // Stopped part way through: local_w ran ahead, so redo the run from
+        // its start only up to the generation that was reached
+        if (g + 1 < n) local_w = cart_run(&cart, band, views, start, g + 1, NULL, 0, counts);
     }
 
     // Stop timer
@@ -336,63 +315,7 @@ int main(int argc, char *argv[])
     // Optional: Write final world to file
     if (NOOUTPUTFILE != 1) {
         // Gather all local domains to rank 0
-        char *global_w = NULL;
-        int *recvcounts = NULL;
-        int *displs = NULL;
-
-        if (rank == 0) {
-            global_w = (char *)malloc(w_X * w_Y * sizeof(char));
-            if (!global_w) {
-                printf("Error: Failed to allocate memory for global world\n");
-                MPI_Abort(MPI_COMM_WORLD, 1);
-            }
-
-            // Initialize with zeros
-            for (int i = 0; i < w_X * w_Y; i++) {
-                global_w[i] = 0;
-            }
-
-            recvcounts = (int *)malloc(size * sizeof(int));
-            displs = (int *)malloc(size * sizeof(int));
-
-            if (!recvcounts || !displs) {
-                printf("Error: Failed to allocate memory for gather parameters\n");
-                MPI_Abort(MPI_COMM_WORLD, 1);
-            }
-
-            // Calculate receive counts and displacements
-            int pos = 0;
-            for (int i = 0; i < size; i++) {
-                int i_local_w_Y = w_Y / size;
-                if (i == size - 1) {
-                    i_local_w_Y += w_Y % size;
-                }
-                recvcounts[i] = w_X * i_local_w_Y;
-                displs[i] = pos;
-                pos += recvcounts[i];
-            }
-        }
-
-        // Pack local data (without ghost rows) for gathering
-        char *local_data = (char *)malloc(w_X * local_w_Y * sizeof(char));
-        if (!local_data) {
-            printf("Error: Failed to allocate memory for local data on process %d\n", rank);
-            MPI_Abort(MPI_COMM_WORLD, 1);
-        }
-
-        // Copy data from 2D array to 1D array for gathering
-        for (int y = 0; y < local_w_Y; y++) {
-            for (int x = 0; x < w_X; x++) {
-                local_data[y * w_X + x] = local_w[y + 1][x];  // +1 to skip ghost row
-            }
-        }
-
-        // Gather data to rank 0
-        MPI_Gatherv(local_data, w_X * local_w_Y, MPI_CHAR,
-                   global_w, recvcounts, displs, MPI_CHAR,
-                   0, MPI_COMM_WORLD);
-
-        free(local_data);
+        char *global_w = cart_gather(&cart, local_w);
 
         // Write to file on rank 0
         if (rank == 0) {
@@ -401,7 +324,7 @@ int main(int argc, char *argv[])
                 // Write data in column-major format as expected by the assignment
                 for (int x = 0; x < w_X; x++) {
                     for (int y = 0; y < w_Y; y++) {
-                        fprintf(fd, "%d", (int)global_w[y * w_X + x]);
+                        fprintf(fd, "%d", (int)global_w[(size_t)y * w_X + x]);
                     }
                     fprintf(fd, "\n");
                 }
@@ -411,11 +334,12 @@ int main(int argc, char *argv[])
             }
 
             free(global_w);
-            free(recvcounts);
-            free(displs);
         }
     }
 
+    for (int i = 0; i < grid_count; i++) grid_free(&grids[i]);
+    cart_free(&cart);
+
     MPI_Finalize();
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "life.h"
 
 #ifdef NOOUTPUTFILE
 #define NOOUTPUTFILE 1
@@ -7,44 +11,65 @@
 #define NOOUTPUTFILE 0
 #endif
 
-#define MAX_N 8192
-
 #ifndef DEBUG_LEVEL
 #define DEBUG_LEVEL 0
 #endif
 
-char w[MAX_N][MAX_N];
-char neww[MAX_N][MAX_N];
+/* World plus its zero border, allocated by init(); index through CELL() */
+Grid grids[2];
+Grid *w = &grids[0];
+Grid *neww = &grids[1];
 
 int w_X, w_Y;
 
-/* Same initialization and utility functions as in the sequential code */
+/* Allocate both grids once w_X and w_Y are known, and zero them with the
+   same static split of the rows as the update loops, so each thread's rows
+   are on its own NUMA node */
+void alloc_world()
+{
+  char pages[128];
+  int y;
+
+  if (grid_alloc_untouched(w, w_X, w_Y) != 0 || grid_alloc_untouched(neww, w_X, w_Y) != 0) {
+    printf("Error: Failed to allocate memory for a %d x %d world\n", w_X, w_Y);
+    exit(1);
+  }
+
+  #pragma omp parallel for schedule(static)
+  for (y=0; y<w_Y; y++) {
+    grid_zero_rows(w, y, y+1);
+    grid_zero_rows(neww, y, y+1);
+  }
+  grid_zero_rows(w, -1, 0);
+  grid_zero_rows(neww, -1, 0);
+  grid_zero_rows(w, w_Y, w_Y+1);
+  grid_zero_rows(neww, w_Y, w_Y+1);
+  if (grid_describe_pages(w, pages, sizeof(pages)) == 0) printf("World grids on %s\n", pages);
+}
+
+/* Same initialization and utility functions as in the sequential code;
+   alloc_world() has already zeroed the world */
 void init(int X, int Y)
 {
-  int i, j;
+  int i;
   w_X = X,  w_Y = Y;
-  for (i=0; i<w_X;i++)
-    for (j=0; j<w_Y; j++)
-      w[j][i] = 0;
+  alloc_world();
 
-  for (i=0; i<w_X && i < w_Y; i++) w[i][i] = 1;
-  for (i=0; i<w_Y && i < w_X; i++) w[w_Y - 1 - i][i] = 1;
+  for (i=0; i<w_X && i < w_Y; i++) CELL(w, i, i) = 1;
+  for (i=0; i<w_Y && i < w_X; i++) CELL(w, w_Y - 1 - i, i) = 1;
 }
 
 void test_init()
 {
   printf("Test on a small 4x6 world\n");
-  int i, j;
   w_X = 4;
   w_Y = 6;
+  alloc_world();
 
-  for (i=0; i<w_X;i++)
-    for (j=0; j<w_Y; j++)
-      w[j][i] = 0;
-  w[0][3] = 1;
-  w[1][3] = 1;
-  w[2][1] = 1;
-  w[3][0] = w[3][1] = w[3][2] = w[4][1] = w[5][1] = 1;
+  CELL(w, 0, 3) = 1;
+  CELL(w, 1, 3) = 1;
+  CELL(w, 2, 1) = 1;
+  CELL(w, 3, 0) = CELL(w, 3, 1) = CELL(w, 3, 2) = CELL(w, 4, 1) = CELL(w, 5, 1) = 1;
 }
 
 void print_world()
@@ -53,7 +78,7 @@ void print_world()
 
   for (i=0; i<w_Y; i++) {
     for (j=0; j<w_X; j++) {
-      printf("%d", (int)w[i][j]);
+      printf("%d", (int)CELL(w, i, j));
     }
     printf("\n");
   }
@@ -61,108 +86,460 @@ void print_world()
 
 int neighborcount(int x, int y)
 {
-  int count = 0;
+  /* The zero border gives every cell, edges and corners included, the
+     same eight neighbors */
+  return CELL(w, y-1, x-1) + CELL(w, y-1, x) + CELL(w, y-1, x+1)
+         + CELL(w, y, x-1) + CELL(w, y, x+1)
+         + CELL(w, y+1, x-1) + CELL(w, y+1, x) + CELL(w, y+1, x+1);
+}
 
-  if ((x<0) || (x >=w_X)) {
-    printf("neighborcount: (%d %d) out of bound (0..%d, 0..%d).\n", x,y,
-           w_X, w_Y);
-    exit(0);
-  }
-  if ((y<0) || (y >=w_Y)) {
-    printf("neighborcount: (%d %d) out of bound (0..%d, 0..%d).\n", x,y,
-           w_X, w_Y);
-    exit(0);
+/* Make the generation just computed in neww the current one */
+void swap_grids()
+{
+  Grid *t = w;
+  w = neww;
+  neww = t;
+}
+
+/* Next state of row y with the vector kernel, returns its population */
+long simd_update_row(int y)
+{
+  return simd_row(GRID_ROW(neww, y), GRID_ROW(w, y-1), GRID_ROW(w, y),
+                  GRID_ROW(w, y+1), w_X);
+}
+
+/*
+ * --dataflow: every generation is a set of tasks on bands of rows, and
+ * depend clauses take the place of the barriers between generations. A
+ * band starts as soon as the bands it reads (its own and the two next to
+ * it) of the generation before are done, and once the band of the grid it
+ * writes is no longer read. dep[p] holds one sentinel per band of grid p,
+ * plus one at each end that no task writes.
+ *
+ * The master queues one generation ahead of the one whose population it
+ * is checking. When the stop rule trips, that extra generation was
+ * computed for nothing, but it only wrote the other grid, so dropping it
+ * is the whole rollback.
+ */
+void run_dataflow(BandKernel band, long init_count)
+{
+  Grid *g[2] = { w, neww };
+  int nb = 8 * omp_get_max_threads();
+  int rows, last = -1;
+  char *dep[2];
+  long *counts[2];
+
+  if (nb > w_Y) nb = w_Y;
+  rows = (w_Y + nb - 1) / nb;
+  rows += rows & 1;           /* whole row pairs for the lookup table */
+  nb = (w_Y + rows - 1) / rows;
+
+  dep[0] = (char *)calloc(nb + 2, 1);
+  dep[1] = (char *)calloc(nb + 2, 1);
+  counts[0] = (long *)calloc(nb, sizeof(long));
+  counts[1] = (long *)calloc(nb, sizeof(long));
+  if (!dep[0] || !dep[1] || !counts[0] || !counts[1]) {
+    printf("Error: Failed to allocate memory for the dataflow bands\n");
+    exit(1);
   }
 
-  if (x==0) {
-    if (y == 0) {
-      count = w[y][x+1] + w[y+1][x] + w[y+1][x+1];
-    } else if (y == w_Y-1) {
-      count = w[y][x+1] + w[y-1][x] + w[y-1][x+1];
-    } else {
-      count = w[y-1][x] + w[y+1][x] + w[y-1][x+1] + w[y][x+1] + w[y+1][x+1];
+  #pragma omp parallel
+  #pragma omp single
+  {
+    int iter, k, j;
+
+    for (iter = 0; iter < 200 && init_count > 0; iter++) {
+      long count = 0;
+
+      /* Generation iter + 1 from generation iter, plus the one after
+         when starting up */
+      for (k = iter == 0 ? 0 : iter + 1; k <= iter + 1 && k < 200; k++) {
+        for (j = 0; j < nb; j++) {
+          Grid *src = g[k % 2], *dst = g[(k + 1) % 2];
+          long *cnt = counts[k % 2];
+          int y0 = j * rows, y1 = y0 + rows < w_Y ? y0 + rows : w_Y;
+
+          #pragma omp task firstprivate(src, dst, cnt, j, y0, y1) \
+                           depend(in: dep[k % 2][j], dep[k % 2][j+1], dep[k % 2][j+2]) \
+                           depend(out: dep[(k + 1) % 2][j+1])
+          cnt[j] = band(dst, src, y0, y1);
+        }
+      }
+
+      /* Wait only for the bands of this iteration */
+      #pragma omp taskwait depend(iterator(b = 1 : nb + 1), in: dep[(iter + 1) % 2][b])
+
+      for (j = 0; j < nb; j++) count += counts[iter % 2][j];
+      last = iter;
+      printf("iter = %d, population count = %ld\n", iter, count);
+      if (DEBUG_LEVEL > 10) {
+        w = g[(iter + 1) % 2];
+        print_world();
+      }
+      if (!(count < 50*init_count && count > init_count / 50)) break;
     }
-  } else if (x == w_X -1) {
-    if (y == 0) {
-      count = w[y][x-1] + w[y+1][x-1] + w[y+1][x];
-    } else if (y == w_Y-1) {
-      count = w[y][x-1] + w[y-1][x] + w[y-1][x-1];
-    } else {
-      count = w[y-1][x] + w[y+1][x] + w[y-1][x-1] + w[y][x-1] + w[y+1][x-1];
+
+    #pragma omp taskwait
+  }
+
+  /* The grid of the last generation checked is the current one */
+  w = g[(last + 1) % 2];
+  neww = g[last % 2];
+
+  free(dep[0]);
+  free(dep[1]);
+  free(counts[0]);
+  free(counts[1]);
+}
+
+/*
+ * --omp-tune: ways to split a generation between the threads. The world
+ * is cut into tile_w x tile_h tiles (0 for the whole width or height),
+ * handed out by a collapsed loop with the given schedule and chunk (0 for
+ * the runtime's default). One-row tiles as wide as the world are the plain
+ * row loop, tiles as tall as it are column strips.
+ */
+typedef struct {
+  omp_sched_t kind;
+  int chunk;
+  int tile_w, tile_h;
+} OmpConfig;
+
+OmpConfig candidates[] = {
+  { omp_sched_static,  0,    0,  1 },
+  { omp_sched_static,  1,    0,  1 },
+  { omp_sched_dynamic, 4,    0,  1 },
+  { omp_sched_dynamic, 16,   0,  1 },
+  { omp_sched_guided,  1,    0,  1 },
+  { omp_sched_static,  0,  256,  0 },
+  { omp_sched_static,  0, 1024, 32 },
+  { omp_sched_dynamic, 1,  256, 64 },
+  { omp_sched_dynamic, 1, 1024, 32 },
+  { omp_sched_dynamic, 1, 4096, 16 }
+};
+
+#define NUM_CANDIDATES ((int)(sizeof(candidates) / sizeof(candidates[0])))
+
+/* Next candidate to time (NUM_CANDIDATES once done), the fastest so far,
+   and the configuration in use after that */
+int tune_next = 0;
+int tune_best = -1;
+double tune_best_time = 0;
+OmpConfig tuned;
+
+const char *sched_name(omp_sched_t kind)
+{
+  switch (kind) {
+  case omp_sched_static: return "static";
+  case omp_sched_dynamic: return "dynamic";
+  case omp_sched_guided: return "guided";
+  default: return "auto";
+  }
+}
+
+void print_config(const OmpConfig *cfg)
+{
+  printf("schedule %s,%d, ", sched_name(cfg->kind), cfg->chunk);
+  if (cfg->tile_w == 0 && cfg->tile_h == 1) printf("rows");
+  else if (cfg->tile_h == 0) printf("%d-column strips", cfg->tile_w);
+  else printf("%dx%d tiles", cfg->tile_w, cfg->tile_h);
+}
+
+/* One generation with the given split, returns the new population */
+long run_config(const OmpConfig *cfg, RowKernel kernel)
+{
+  int tw = cfg->tile_w > 0 && cfg->tile_w < w_X ? cfg->tile_w : w_X;
+  int th = cfg->tile_h > 0 && cfg->tile_h < w_Y ? cfg->tile_h : w_Y;
+  int nx = (w_X + tw - 1) / tw, ny = (w_Y + th - 1) / th;
+  int bx, by;
+  long count = 0;
+
+  omp_set_schedule(cfg->kind, cfg->chunk);
+  #pragma omp parallel for collapse(2) schedule(runtime) reduction(+:count)
+  for (by=0; by<ny; by++) {
+    for (bx=0; bx<nx; bx++) {
+      int x0 = bx * tw, n = x0 + tw < w_X ? tw : w_X - x0;
+      int y1 = (by + 1) * th < w_Y ? (by + 1) * th : w_Y;
+
+      for (int y=by*th; y<y1; y++)
+        count += kernel(GRID_ROW(neww, y) + x0, GRID_ROW(w, y-1) + x0, GRID_ROW(w, y) + x0,
+                        GRID_ROW(w, y+1) + x0, n);
     }
-  } else { /* x is in the middle */
-    if (y == 0) {
-      count = w[y][x-1] + w[y][x+1] + w[y+1][x-1] + w[y+1][x] + w[y+1][x+1];
-    } else if (y == w_Y-1) {
-      count = w[y][x-1] + w[y][x+1] + w[y-1][x-1] + w[y-1][x] + w[y-1][x+1];
-    } else {
-      count = w[y-1][x-1] + w[y][x-1] + w[y+1][x-1] + w[y-1][x] + w[y+1][x]
-              + w[y-1][x+1] + w[y][x+1] + w[y+1][x+1];
+  }
+  return count;
+}
+
+/* Look up a setup saved for this world, thread count and engine */
+int load_profile(const char *file, const char *engine)
+{
+  char kind[16], eng[16];
+  int x, y, t, chunk, tw, th;
+  FILE *fd = fopen(file, "r");
+
+  if (!fd) return -1;
+  while (fscanf(fd, " omp %d %d %d %15s %15s %d %d %d", &x, &y, &t, eng, kind,
+                &chunk, &tw, &th) == 8) {
+    int found = -1;
+
+    if (x != w_X || y != w_Y || t != omp_get_max_threads() || strcmp(eng, engine) != 0)
+      continue;
+    /* A schedule this program does not know, or a bad split, is no setup */
+    for (int i = 0; i < NUM_CANDIDATES && found < 0; i++) {
+      if (strcmp(kind, sched_name(candidates[i].kind)) == 0) found = i;
     }
+    if (found < 0 || chunk < 0 || tw < 0 || th < 0) continue;
+    tuned.kind = candidates[found].kind;
+    tuned.chunk = chunk;
+    tuned.tile_w = tw;
+    tuned.tile_h = th;
+    fclose(fd);
+    return 0;
+  }
+  fclose(fd);
+  return -1;
+}
+
+void save_profile(const char *file, const char *engine)
+{
+  FILE *fd = fopen(file, "a");
+
+  if (!fd) {
+    printf("Can't write the tuning profile %s\n", file);
+    return;
+  }
+  fprintf(fd, "omp %d %d %d %s %s %d %d %d\n", w_X, w_Y, omp_get_max_threads(), engine,
+          sched_name(tuned.kind), tuned.chunk, tuned.tile_w, tuned.tile_h);
+  fclose(fd);
+}
+
+/*
+ * A generation under --omp-tune. The first warms the caches with the
+ * plain row loop; each of the next ones times another candidate, and once
+ * all have had their turn the fastest is kept (and saved to the profile
+ * file) for the rest of the run.
+ */
+long tuned_step(int iter, RowKernel kernel, const LifeOptions *opts)
+{
+  double start;
+  long count;
+
+  if (tune_next == NUM_CANDIDATES) return run_config(&tuned, kernel);
+  if (iter == 0) return run_config(&candidates[0], kernel);
+
+  start = omp_get_wtime();
+  count = run_config(&candidates[tune_next], kernel);
+  start = omp_get_wtime() - start;
+
+  if (DEBUG_LEVEL > 0) {
+    printf("Tuning: ");
+    print_config(&candidates[tune_next]);
+    printf(": %.3f ms\n", start * 1e3);
+  }
+  if (tune_best < 0 || start < tune_best_time) {
+    tune_best = tune_next;
+    tune_best_time = start;
   }
 
+  if (++tune_next == NUM_CANDIDATES) {
+    tuned = candidates[tune_best];
+    printf("Tuned OpenMP setup: ");
+    print_config(&tuned);
+    printf(" (%.3f ms per generation)\n", tune_best_time * 1e3);
+    if (opts->omp_profile) save_profile(opts->omp_profile, engine_name(opts->engine));
+  }
   return count;
 }
 
+/* Pin the threads to CPUs with --pin (OMP_PLACES and OMP_PROC_BIND can do
+   the same from the environment), and say where they run, with detail
+   each one */
+void place_threads(int pin, int detail)
+{
+  int n = omp_get_max_threads();
+  int *cpu = (int *)malloc(n * sizeof(int));
+
+  if (!cpu) return;
+  #pragma omp parallel num_threads(n)
+  {
+    int t = omp_get_thread_num();
+    cpu[t] = pin ? life_pin_thread(t) : life_current_cpu();
+  }
+
+  life_print_placement("Thread", cpu, n, pin, detail);
+  free(cpu);
+}
+
 /* Same start to main code*/
 int main(int argc, char *argv[])
 {
   int x, y;
   int iter = 0;
   int c;
-  int init_count;
-  int count;
+  long init_count;
+  long count;
+  LifeOptions opts;
+  BitWorld bw;
+  ActiveTiles at;
+  long active = 0;
+  unsigned engines = ENGINE_BIT(ENGINE_BYTE) | ENGINE_BIT(ENGINE_BITPACK) |
+                     ENGINE_BIT(ENGINE_SIMD) | ENGINE_BIT(ENGINE_LUT) |
+                     ENGINE_BIT(ENGINE_BOX);
+  unsigned profiled;
+
+  if (life_parse_options(&argc, argv, &opts) != 0) exit(0);
+  if (opts.tune) exit(life_tune(opts.profile) != 0);
+
+  /* The profile only picks among the engines the other options work with */
+  profiled = engines;
+  if (opts.dataflow) profiled &= ~ENGINE_BIT(ENGINE_BITPACK);
+  if (opts.omp_tune) profiled &= ENGINE_BIT(ENGINE_BYTE) | ENGINE_BIT(ENGINE_SIMD);
+  life_apply_profile(&opts, profiled);
+  if (life_check_engine(&opts, engines) != 0) exit(0);
+
+  /* Before the world is allocated, so the first touch is from the
+     threads' final CPUs */
+  place_threads(opts.pin, DEBUG_LEVEL > 0);
 
   if (argc == 1) {
-    printf("Usage: ./a.out w_X w_Y\n");
+    printf("Usage: ./a.out w_X w_Y [options]\n");
+    life_print_options();
     exit(0);
   } else if (argc == 2)
     test_init();
   else /* more than three parameters */
     init(atoi(argv[1]), atoi(argv[2]));
 
-  c = 0;
+  count = 0;
   for (x=0; x<w_X; x++) {
     for (y=0; y<w_Y; y++) {
-      if (w[y][x] == 1) c++;
+      if (CELL(w, y, x) == 1) count++;
     }
   }
 
-  init_count = c;
-  count = init_count;
+  init_count = count;
 
-  printf("initial world, population count: %d\n", c);
+  printf("initial world, population count: %ld\n", count);
   if (DEBUG_LEVEL > 10) print_world();
 
-  for (iter = 0; (iter < 200) && (count <50*init_count) &&
-     (count > init_count / 50); iter ++) {
-
-    /* OpenMP directive for the first nested loop */
-    #pragma omp parallel for private(y, c)
-    for (x=0; x < w_X; x++) {
-      for (y=0; y<w_Y; y++) {
-        c = neighborcount(x, y);  /* count neighbors */
-        if (c <= 1) neww[y][x] = 0;      /* die of loneliness */
-        else if (c >=4) neww[y][x] = 0;  /* die of overpopulation */
-        else if (c == 3)  neww[y][x] = 1;             /* becomes alive */
-        else neww[y][x] = w[y][x];   /* c == 2, no change */
-      }
+  if (opts.engine == ENGINE_SIMD) {
+    if (simd_init(opts.isa) != 0) exit(0);
+    printf("Using the %s vector kernel\n", simd_isa());
+  }
+
+  if (opts.engine == ENGINE_LUT) lut_init();
+
+  if (opts.engine == ENGINE_BITPACK) {
+    if (bitworld_alloc(&bw, w_X, w_Y) != 0) {
+      printf("Error: Failed to allocate memory for the bit-packed world\n");
+      exit(1);
     }
+    bitworld_load(&bw, GRID_ROW(w, 0), w->stride);
+  }
+
+  if (opts.dataflow && (opts.active || opts.engine == ENGINE_BITPACK)) {
+    printf("--dataflow works with the byte, simd, lut and box engines, without --active\n");
+    exit(0);
+  }
+
+  if (opts.omp_tune && (opts.active || opts.dataflow ||
+                        (opts.engine != ENGINE_BYTE && opts.engine != ENGINE_SIMD))) {
+    printf("--omp-tune works with the byte and simd engines, without --active or --dataflow\n");
+    exit(0);
+  }
+
+  if (opts.omp_tune && opts.omp_profile &&
+      load_profile(opts.omp_profile, engine_name(opts.engine)) == 0) {
+    tune_next = NUM_CANDIDATES;
+    printf("OpenMP setup from %s: ", opts.omp_profile);
+    print_config(&tuned);
+    printf("\n");
+  }
+
+  if (opts.active && active_alloc(&at, w_X, w_Y, opts.active) != 0) {
+    printf("Error: Failed to allocate memory for the active tiles\n");
+    exit(1);
+  }
+
+  if (opts.dataflow) {
+    run_dataflow(opts.engine == ENGINE_SIMD ? simd_band :
+                 opts.engine == ENGINE_LUT ? lut_band :
+                 opts.engine == ENGINE_BOX ? box_band : scalar_band, init_count);
+  } else {
+    for (iter = 0; (iter < 200) && (count <50*init_count) &&
+       (count > init_count / 50); iter ++) {
 
-    /* copy the world, and count the current lives */
-    count = 0;
-    /* OpenMP directive for the second nested loop with reduction */
-    #pragma omp parallel for private(y) reduction(+:count)
-    for (x=0; x<w_X; x++) {
-      for (y=0; y<w_Y; y++) {
-        w[y][x] = neww[y][x];
-        if (w[y][x] == 1) count++;
+      if (opts.engine == ENGINE_BITPACK) {
+        long total = 0;
+
+        /* Rows of the bit-packed world are independent within a generation */
+        #pragma omp parallel for reduction(+:total)
+        for (y=0; y < w_Y; y++) {
+          total += bitworld_step(&bw, y, y + 1);
+        }
+        bitworld_swap(&bw);
+        count = total;
+        if (DEBUG_LEVEL > 10) bitworld_store(&bw, GRID_ROW(w, 0), w->stride);
+      } else {
+        /* Split the rows, which are contiguous, between the threads and count
+           the new generation while writing it */
+        count = 0;
+        if (opts.active) {
+          RowKernel kernel = opts.engine == ENGINE_SIMD ? simd_row : scalar_row;
+          int ty;
+
+          /* A row of tiles per thread at a time; skipped tiles make the
+             rows uneven, hence the dynamic schedule */
+          active = 0;
+          #pragma omp parallel for schedule(dynamic) reduction(+:count, active)
+          for (ty=0; ty < at.tiles_y; ty++) {
+            int y1 = (ty + 1) * at.tile < w_Y ? (ty + 1) * at.tile : w_Y;
+            count += active_step(&at, neww, w, kernel, ty * at.tile, y1, &active);
+          }
+          active_swap(&at);
+        } else if (opts.omp_tune) {
+          count = tuned_step(iter, opts.engine == ENGINE_SIMD ? simd_row : scalar_row, &opts);
+        } else if (opts.engine == ENGINE_SIMD) {
+          #pragma omp parallel for reduction(+:count)
+          for (y=0; y<w_Y; y++) count += simd_update_row(y);
+        } else if (opts.engine == ENGINE_LUT) {
+          /* The table does rows in pairs, so hand them out that way */
+          #pragma omp parallel for reduction(+:count)
+          for (y=0; y<w_Y; y+=2) count += lut_band(neww, w, y, y+2 < w_Y ? y+2 : w_Y);
+        } else if (opts.engine == ENGINE_BOX) {
+          #pragma omp parallel for reduction(+:count)
+          for (y=0; y<w_Y; y++) count += box_band(neww, w, y, y+1);
+        } else {
+          #pragma omp parallel for private(x, c) reduction(+:count)
+          for (y=0; y<w_Y; y++) {
+            for (x=0; x < w_X; x++) {
+              c = neighborcount(x, y);  /* count neighbors */
+              if (c <= 1) CELL(neww, y, x) = 0;      /* die of loneliness */
+              else if (c >=4) CELL(neww, y, x) = 0;  /* die of overpopulation */
+              else if (c == 3)  CELL(neww, y, x) = 1;             /* becomes alive */
+              else CELL(neww, y, x) = CELL(w, y, x);   /* c == 2, no change */
+              count += CELL(neww, y, x);
+            }
+          }
+        }
+
+        /* The new generation becomes the current one, no copy needed */
+        swap_grids();
       }
+
+      if (opts.active)
+        printf("iter = %d, population count = %ld, active tiles = %ld of %ld\n",
+               iter, count, active, active_total(&at));
+      else
+        printf("iter = %d, population count = %ld\n", iter, count);
+      if (DEBUG_LEVEL > 10) print_world();
     }
+  }
 
-    printf("iter = %d, population count = %d\n", iter, count);
-    if (DEBUG_LEVEL > 10) print_world();
+  if (opts.engine == ENGINE_BITPACK) {
+    bitworld_store(&bw, GRID_ROW(w, 0), w->stride);
+    bitworld_free(&bw);
   }
+  if (opts.active) active_free(&at);
 
   if (NOOUTPUTFILE != 1)
   {
@@ -170,7 +547,7 @@ int main(int argc, char *argv[])
     if ((fd = fopen("final_world000.txt", "w")) != NULL) {
       for (x=0; x<w_X; x++) {
         for (y=0; y<w_Y; y++) {
-          fprintf(fd, "%d", (int)w[y][x]);
+          fprintf(fd, "%d", (int)CELL(w, y, x));
         }
         fprintf(fd, "\n");
       }
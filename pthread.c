@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <time.h>
-#include <errno.h>
+#include <unistd.h>
+
+#include "life.h"
 
 #ifdef NOOUTPUTFILE
 #define NOOUTPUTFILE 1
@@ -11,18 +14,27 @@
 #define NOOUTPUTFILE 0
 #endif
 
-#define MAX_N 8192
 #define MAX_THREADS 64
 #define MAX_TASKS 10000
 
+/* Counters written by several threads get a cache line each */
+#define CACHE_LINE 64
+
+/* Polls of the barrier before a waiting thread goes to sleep, when there
+   is a CPU for every thread (otherwise spinning only delays the others) */
+#define SPIN_LIMIT 4000
+
 #ifndef DEBUG_LEVEL
 #define DEBUG_LEVEL 0
 #endif
 
-char w[MAX_N][MAX_N];
-char neww[MAX_N][MAX_N];
+/* World plus its zero border, allocated by init(); index through CELL() */
+Grid grids[2];
+Grid *w = &grids[0];
+Grid *neww = &grids[1];
 
 int w_X, w_Y;
+int nthreads = 4;  /* Default number of threads */
 
 /* Dynamic task queue */
 typedef struct {
@@ -35,51 +47,125 @@ typedef struct {
 typedef struct {
     int id;
     int nthreads;
+    int cpu;            /* where it started, or was pinned with --pin */
     pthread_t thread;
 } ThreadInfo;
 
 ThreadInfo thread_info[MAX_THREADS];
 
-/* Task queue */
+/*
+ * Generation barrier for the master and the workers. The last thread to
+ * arrive moves the phase on; the others spin on the phase for a while, as
+ * the next generation usually starts soon, then sleep until it changes.
+ * The phase only changes under the lock, so a sleeper cannot miss it.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_int waiting;
+    _Alignas(CACHE_LINE) atomic_int phase;
+    int parties;
+    int spin;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Barrier;
+
+Barrier barrier;
+
+/* Task queue, filled by the master between generations */
 Task task_queue[MAX_TASKS];
 int num_tasks = 0;
-int next_task = 0;
-int active_threads = 0;
 
-/* Synchronization */
-pthread_mutex_t task_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t task_cond = PTHREAD_COND_INITIALIZER;
-pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+/*
+ * Work-stealing deque of each worker: a range of task_queue, head in the
+ * low 32 bits and tail in the high ones, changed with compare-and-swap.
+ * Each worker's range is the chunks of its own band of rows, largest
+ * first. The owner takes them from the head, so it keeps to its rows from
+ * one generation to the next; a worker whose deque is empty steals from
+ * the tail of the fullest one, where the smallest chunks are.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_ullong ends;
+} Deque;
+
+Deque deques[MAX_THREADS];
 
-/* Flags */
-int current_iteration = 0;
+/* What the tasks of the current round are for, and whether there are
+   any more rounds; both set by the master before the barrier */
+typedef enum {
+    PHASE_UPDATE,   /* next generation into neww, counted as it is written */
+    PHASE_COUNT,    /* population of w */
+    PHASE_ZERO      /* first touch: zero the rows of both grids */
+} Phase;
+
+Phase phase = PHASE_UPDATE;
 int program_done = 0;
 
-/* Same initialization and utility functions as in the sequential code */
+/* Each worker's population and active tile totals for the round, a cache
+   line each; the master adds them up after the barrier. With --task-us
+   also the rows it computed, the time its tasks took and when it ran out
+   of them, in ns from the start of the round. */
+typedef struct {
+    _Alignas(CACHE_LINE) long count;
+    long active;
+    long rows;
+    long busy_ns;
+    long finish_ns;
+} Partial;
+
+Partial partials[MAX_THREADS];
+
+/* --task-us: cost of a row as measured over the last generations, 0 until
+   one has been timed, and when the current round started */
+double row_ns = 0;
+struct timespec round_start;
+
+/* Update engine, and the bit-packed world when that engine is used */
+LifeOptions opts;
+BitWorld bw;
+ActiveTiles at;
+
+long run_round(Phase p, int iteration, long *active);
+
+/* Allocate both grids once w_X and w_Y are known. The workers zero them
+   over the same bands they compute, so each one's rows are first touched,
+   and so placed, on its own NUMA node. */
+void alloc_world() {
+    char pages[128];
+    long unused;
+
+    if (grid_alloc_untouched(w, w_X, w_Y) != 0 || grid_alloc_untouched(neww, w_X, w_Y) != 0) {
+        printf("Error: Failed to allocate memory for a %d x %d world\n", w_X, w_Y);
+        exit(1);
+    }
+
+    run_round(PHASE_ZERO, 0, &unused);
+    grid_zero_rows(w, -1, 0);
+    grid_zero_rows(neww, -1, 0);
+    grid_zero_rows(w, w_Y, w_Y + 1);
+    grid_zero_rows(neww, w_Y, w_Y + 1);
+    if (grid_describe_pages(w, pages, sizeof(pages)) == 0) printf("World grids on %s\n", pages);
+}
+
+/* Same initialization and utility functions as in the sequential code;
+   alloc_world() has already zeroed the world */
 void init(int X, int Y) {
-    int i, j;
+    int i;
     w_X = X, w_Y = Y;
-    for (i = 0; i < w_X; i++)
-        for (j = 0; j < w_Y; j++)
-            w[j][i] = 0;
+    alloc_world();
 
-    for (i = 0; i < w_X && i < w_Y; i++) w[i][i] = 1;
-    for (i = 0; i < w_Y && i < w_X; i++) w[w_Y - 1 - i][i] = 1;
+    for (i = 0; i < w_X && i < w_Y; i++) CELL(w, i, i) = 1;
+    for (i = 0; i < w_Y && i < w_X; i++) CELL(w, w_Y - 1 - i, i) = 1;
 }
 
 void test_init() {
     printf("Test on a small 4x6 world\n");
-    int i, j;
     w_X = 4;
     w_Y = 6;
+    alloc_world();
 
-    for (i = 0; i < w_X; i++)
-        for (j = 0; j < w_Y; j++)
-            w[j][i] = 0;
-    w[0][3] = 1;
-    w[1][3] = 1;
-    w[2][1] = 1;
-    w[3][0] = w[3][1] = w[3][2] = w[4][1] = w[5][1] = 1;
+    CELL(w, 0, 3) = 1;
+    CELL(w, 1, 3) = 1;
+    CELL(w, 2, 1) = 1;
+    CELL(w, 3, 0) = CELL(w, 3, 1) = CELL(w, 3, 2) = CELL(w, 4, 1) = CELL(w, 5, 1) = 1;
 }
 
 void print_world() {
@@ -87,72 +173,174 @@ void print_world() {
 
     for (i = 0; i < w_Y; i++) {
         for (j = 0; j < w_X; j++) {
-            printf("%d", (int)w[i][j]);
+            printf("%d", (int)CELL(w, i, j));
         }
         printf("\n");
     }
 }
 
 int neighborcount(int x, int y) {
-    int count = 0;
+    /* The zero border gives every cell, edges and corners included, the
+       same eight neighbors */
+    return CELL(w, y-1, x-1) + CELL(w, y-1, x) + CELL(w, y-1, x+1)
+           + CELL(w, y, x-1) + CELL(w, y, x+1)
+           + CELL(w, y+1, x-1) + CELL(w, y+1, x) + CELL(w, y+1, x+1);
+}
 
-    if ((x < 0) || (x >= w_X)) {
-        printf("neighborcount: (%d %d) out of bound (0..%d, 0..%d).\n", x, y, w_X, w_Y);
-        exit(0);
-    }
-    if ((y < 0) || (y >= w_Y)) {
-        printf("neighborcount: (%d %d) out of bound (0..%d, 0..%d).\n", x, y, w_X, w_Y);
-        exit(0);
+void barrier_init(Barrier *b, int parties) {
+    atomic_init(&b->waiting, 0);
+    atomic_init(&b->phase, 0);
+    b->parties = parties;
+    b->spin = parties <= sysconf(_SC_NPROCESSORS_ONLN) ? SPIN_LIMIT : 0;
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->cond, NULL);
+}
+
+void barrier_destroy(Barrier *b) {
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->cond);
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+void barrier_wait(Barrier *b) {
+    int seen = atomic_load_explicit(&b->phase, memory_order_acquire);
+
+    if (atomic_fetch_add_explicit(&b->waiting, 1, memory_order_acq_rel) == b->parties - 1) {
+        /* Everyone else is waiting for the phase, so nobody can arrive
+           at the next barrier before it changes */
+        atomic_store_explicit(&b->waiting, 0, memory_order_relaxed);
+        pthread_mutex_lock(&b->lock);
+        atomic_store_explicit(&b->phase, seen + 1, memory_order_release);
+        pthread_cond_broadcast(&b->cond);
+        pthread_mutex_unlock(&b->lock);
+        return;
     }
 
-    if (x == 0) {
-        if (y == 0) {
-            count = w[y][x+1] + w[y+1][x] + w[y+1][x+1];
-        } else if (y == w_Y-1) {
-            count = w[y][x+1] + w[y-1][x] + w[y-1][x+1];
-        } else {
-            count = w[y-1][x] + w[y+1][x] + w[y-1][x+1] + w[y][x+1] + w[y+1][x+1];
-        }
-    } else if (x == w_X - 1) {
-        if (y == 0) {
-            count = w[y][x-1] + w[y+1][x-1] + w[y+1][x];
-        } else if (y == w_Y-1) {
-            count = w[y][x-1] + w[y-1][x] + w[y-1][x-1];
-        } else {
-            count = w[y-1][x] + w[y+1][x] + w[y-1][x-1] + w[y][x-1] + w[y+1][x-1];
-        }
-    } else { /* x is in the middle */
-        if (y == 0) {
-            count = w[y][x-1] + w[y][x+1] + w[y+1][x-1] + w[y+1][x] + w[y+1][x+1];
-        } else if (y == w_Y-1) {
-            count = w[y][x-1] + w[y][x+1] + w[y-1][x-1] + w[y-1][x] + w[y-1][x+1];
-        } else {
-            count = w[y-1][x-1] + w[y][x-1] + w[y+1][x-1] + w[y-1][x] + w[y+1][x]                    + w[y-1][x+1] + w[y][x+1] + w[y+1][x+1];
-        }
+    for (int i = 0; i < b->spin; i++) {
+        if (atomic_load_explicit(&b->phase, memory_order_acquire) != seen) return;
+        cpu_relax();
     }
 
-    return count;
+    pthread_mutex_lock(&b->lock);
+    while (atomic_load_explicit(&b->phase, memory_order_acquire) == seen)
+        pthread_cond_wait(&b->cond, &b->lock);
+    pthread_mutex_unlock(&b->lock);
+}
+
+/* Make the generation just computed in neww the current one */
+void swap_grids() {
+    Grid *t = w;
+    w = neww;
+    neww = t;
+}
+
+/* Nanoseconds from a to b on the monotonic clock */
+long elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1000000000L + (b->tv_nsec - a->tv_nsec);
+}
+
+/* Next state of row y with the vector kernel, returns its population */
+long simd_update_row(int y) {
+    return simd_row(GRID_ROW(neww, y), GRID_ROW(w, y-1), GRID_ROW(w, y),
+                    GRID_ROW(w, y+1), w_X);
 }
 
 /* New functions */
-/* Process a single task */
-void process_task(Task *task) {
+/* Process a single task, return the population of its rows in the new
+   generation; *active gets the number of active tiles computed */
+long process_task(Task *task, long *active) {
+    long count = 0;
+
+    if (phase == PHASE_ZERO) {
+        grid_zero_rows(w, task->start_row, task->end_row);
+        grid_zero_rows(neww, task->start_row, task->end_row);
+        return 0;
+    }
+
+    if (phase == PHASE_COUNT) {
+        for (int y = task->start_row; y < task->end_row; y++) {
+            const char *row = GRID_ROW(w, y);
+            for (int x = 0; x < w_X; x++) count += row[x];
+        }
+        return count;
+    }
+
+    if (opts.active) {
+        RowKernel kernel = opts.engine == ENGINE_SIMD ? simd_row : scalar_row;
+        return active_step(&at, neww, w, kernel, task->start_row, task->end_row, active);
+    }
+
+    if (opts.engine == ENGINE_BITPACK)
+        return bitworld_step(&bw, task->start_row, task->end_row);
+
+    if (opts.engine == ENGINE_SIMD) {
+        for (int y = task->start_row; y < task->end_row; y++) count += simd_update_row(y);
+        return count;
+    }
+
+    if (opts.engine == ENGINE_LUT)
+        return lut_band(neww, w, task->start_row, task->end_row);
+
+    if (opts.engine == ENGINE_BOX)
+        return box_band(neww, w, task->start_row, task->end_row);
+
     for (int y = task->start_row; y < task->end_row; y++) {
         for (int x = 0; x < w_X; x++) {
             int neighbors = neighborcount(x, y);    /* count neighbors */
-            if (neighbors <= 1) neww[y][x] = 0;       /* die of loneliness */
-            else if (neighbors >= 4) neww[y][x] = 0;  /* die of overpopulation */
-            else if (neighbors == 3) neww[y][x] = 1;  /* becomes alive */
-            else neww[y][x] = w[y][x];                /* c == 2, no change */
+            if (neighbors <= 1) CELL(neww, y, x) = 0;       /* die of loneliness */
+            else if (neighbors >= 4) CELL(neww, y, x) = 0;  /* die of overpopulation */
+            else if (neighbors == 3) CELL(neww, y, x) = 1;  /* becomes alive */
+            else CELL(neww, y, x) = CELL(w, y, x);          /* c == 2, no change */
+            count += CELL(neww, y, x);
         }
     }
+    return count;
 }
 
-// Create tasks for the current iteration
-void create_tasks(int iteration) {
-    num_tasks = 0;
-    next_task = 0;
+/* With active tiles a task has to cover whole rows of tiles, and with
+   the lookup table pairs of rows */
+int align_row(int row) {
+    if (opts.active && row < w_Y) {
+        row = (row + opts.active - 1) / opts.active * opts.active;
+        if (row > w_Y) row = w_Y;
+    }
+    if (opts.engine == ENGINE_LUT && row < w_Y) {
+        row = (row + 1) & ~1;
+        if (row > w_Y) row = w_Y;
+    }
+    return row;
+}
+
+/* Queue the chunks of rows [start, end) for one worker: the first third
+   of the rows in first_size chunks, the next in medium_size and the rest in
+   last_size */
+void add_band_tasks(int start, int end, int first_size, int medium_size, int last_size) {
+    int row = start;
+    int third = (end - start) / 3;
+
+    while (row < end) {
+        int size = row - start < third ? first_size
+                 : row - start < 2 * third ? medium_size : last_size;
+        int end_row = align_row(row + size);
+        if (end_row > end) end_row = end;
 
+        task_queue[num_tasks].start_row = row;
+        task_queue[num_tasks].end_row = end_row;
+        task_queue[num_tasks].chunk_size = size;
+        num_tasks++;
+
+        row = end_row;
+    }
+}
+
+/* The fixed schedule: chunks of 5 x 64 rows shrinking to 64, the larger
+   ones shrinking further as the iterations go on */
+void fixed_chunk_sizes(int iteration, int *first, int *last) {
     /* Calculate base chunk size */
     int base_chunk_size = 64;
 
@@ -162,9 +350,6 @@ void create_tasks(int iteration) {
 
     if (num_chunks < 2) num_chunks = 2;
 
-    /* First third: largest chunks
-       Middle third: medium chunks
-       Last third: smallest chunks */
     int first_chunk_size = base_chunk_size * 5;
     int last_chunk_size = base_chunk_size;
 
@@ -175,173 +360,228 @@ void create_tasks(int iteration) {
             first_chunk_size = base_chunk_size * 2;
     }
 
-    /* Don't exceed MAX_TASKS */
-    if (num_chunks > MAX_TASKS) {
+    /* Don't exceed MAX_TASKS; each band can end in up to three short
+       chunks */
+    if (num_chunks > MAX_TASKS - 3 * nthreads) {
         printf("Warning: Increasing chunk size to avoid exceeding task limit\n");
-        base_chunk_size = w_Y / MAX_TASKS + 1;
-        num_chunks = w_Y / base_chunk_size;
-        if (w_Y % base_chunk_size > 0) num_chunks++;
+        base_chunk_size = w_Y / (MAX_TASKS - 3 * nthreads) + 1;
         first_chunk_size = base_chunk_size * 5;
         last_chunk_size = base_chunk_size;
     }
-/*!!!
-    if (DEBUG_LEVEL > 0) {
-        printf("Iteration %d: Creating %d tasks. First chunk: %d, Last chunk: %d\n",                iteration, num_chunks, first_chunk_size, last_chunk_size);
-    }*/
 
-    int row = 0;
-    int third = num_chunks / 3;
-    if (third < 1) third = 1;
+    *first = first_chunk_size;
+    *last = last_chunk_size;
+}
 
-    /* First third */
-    for (int i = 0; i < third && row < w_Y; i++) {
-        int end_row = row + first_chunk_size;
-        if (end_row > w_Y) end_row = w_Y;
+/* --task-us: chunks that take about that long at the measured cost of a
+   row, and a quarter of that at the end of each band so the workers
+   finish close together */
+void adaptive_chunk_sizes(int *first, int *last) {
+    double rows = opts.task_us * 1000.0 / row_ns;
+    int min_rows = w_Y / (MAX_TASKS - 3 * nthreads) + 1;    /* task limit */
+
+    if (rows > w_Y) rows = w_Y;
+    *first = rows < 1 ? 1 : (int)rows;
+    *last = *first / 4 > min_rows ? *first / 4 : min_rows;
+    if (*first < *last) *first = *last;
+}
 
-        task_queue[num_tasks].start_row = row;
-        task_queue[num_tasks].end_row = end_row;
-        task_queue[num_tasks].chunk_size = first_chunk_size;
-        num_tasks++;
+// Create tasks for the current iteration, a band of rows per worker
+void create_tasks(int iteration) {
+    int first_chunk_size, last_chunk_size;
 
-        row = end_row;
-    }
+    num_tasks = 0;
+
+    /* Until a generation has been timed, --task-us starts from the fixed
+       schedule too */
+    if (opts.task_us > 0 && row_ns > 0)
+        adaptive_chunk_sizes(&first_chunk_size, &last_chunk_size);
+    else
+        fixed_chunk_sizes(iteration, &first_chunk_size, &last_chunk_size);
 
-    /* Middle third */
     int medium_chunk_size = (first_chunk_size + last_chunk_size) / 2;
-    for (int i = 0; i < third && row < w_Y; i++) {
-        int end_row = row + medium_chunk_size;
-        if (end_row > w_Y) end_row = w_Y;
+    for (int i = 0; i < nthreads; i++) {
+        int start = align_row((int)((long)w_Y * i / nthreads));
+        int end = align_row((int)((long)w_Y * (i + 1) / nthreads));
+        unsigned long long head = (unsigned long long)num_tasks;
 
-        task_queue[num_tasks].start_row = row;
-        task_queue[num_tasks].end_row = end_row;
-        task_queue[num_tasks].chunk_size = medium_chunk_size;
-        num_tasks++;
+        add_band_tasks(start, end, first_chunk_size, medium_chunk_size, last_chunk_size);
+        atomic_store_explicit(&deques[i].ends, head | (unsigned long long)num_tasks << 32,
+                              memory_order_relaxed);
+    }
 
-        row = end_row;
+    if (DEBUG_LEVEL > 0) {
+        printf("Iteration %d: Created %d tasks. First chunk: %d, Last chunk: %d",
+               iteration, num_tasks, first_chunk_size, last_chunk_size);
+        if (opts.task_us > 0) printf(", %.1f ns per row", row_ns);
+        printf("\n");
     }
+}
 
-    /* Last third */
-    while (row < w_Y && num_tasks < MAX_TASKS) {
-        int end_row = row + last_chunk_size;
-        if (end_row > w_Y) end_row = w_Y;
+/* Next task from the head of the worker's own deque, -1 if it is empty */
+int take_task(Deque *d) {
+    unsigned long long e = atomic_load_explicit(&d->ends, memory_order_relaxed);
 
-        task_queue[num_tasks].start_row = row;
-        task_queue[num_tasks].end_row = end_row;
-        task_queue[num_tasks].chunk_size = last_chunk_size;
-        num_tasks++;
+    while ((unsigned)e < (unsigned)(e >> 32)) {
+        if (atomic_compare_exchange_weak_explicit(&d->ends, &e, e + 1,
+                                                  memory_order_relaxed, memory_order_relaxed))
+            return (int)(unsigned)e;
+    }
+    return -1;
+}
 
-        row = end_row;
+/* Last task of the fullest other deque, -1 once they are all empty */
+int steal_task(int thread_id) {
+    while (1) {
+        Deque *victim = NULL;
+        unsigned most = 0;
+
+        for (int i = 0; i < nthreads; i++) {
+            unsigned long long e = atomic_load_explicit(&deques[i].ends, memory_order_relaxed);
+            unsigned left = (unsigned)(e >> 32) - (unsigned)e;
+
+            if (i != thread_id && (unsigned)e < (unsigned)(e >> 32) && left > most) {
+                victim = &deques[i];
+                most = left;
+            }
+        }
+        if (!victim) return -1;
+
+        unsigned long long e = atomic_load_explicit(&victim->ends, memory_order_relaxed);
+        while ((unsigned)e < (unsigned)(e >> 32)) {
+            if (atomic_compare_exchange_weak_explicit(&victim->ends, &e, e - (1ULL << 32),
+                                                      memory_order_relaxed, memory_order_relaxed))
+                return (int)(e >> 32) - 1;
+        }
     }
-/*!!!
-    if (DEBUG_LEVEL > 0) {
-        printf("Created %d tasks for iteration %d\n", num_tasks, iteration);
-    }*/
 }
 
-/* Worker thread */
+/* Worker thread: one round of tasks between each pair of barriers */
 void *worker_thread(void *arg) {
     ThreadInfo *info = (ThreadInfo *)arg;
     int thread_id = info->id;
-    Task task;
-    int got_task;
+    Partial *part = &partials[thread_id];
+    int t;
+    long rows_count;
+    long rows_active;
+    struct timespec t0, t1;
+
+    /* Before the first round, which is the one that touches the world */
+    info->cpu = opts.pin ? life_pin_thread(thread_id) : life_current_cpu();
 
     while (1) {
-        /* Try to get a task */
-        pthread_mutex_lock(&task_mutex);
-
-        /* Wait for new tasks or program termination */
-        while (next_task >= num_tasks && !program_done && current_iteration > 0) {
-            if (active_threads == 0) {
-                /* All tasks are done */
-                pthread_cond_signal(&done_cond);
+        /* Wait for the master to hand out the next generation */
+        barrier_wait(&barrier);
+        if (program_done) break;
+
+        rows_count = 0;
+        rows_active = 0;
+        part->rows = 0;
+        part->busy_ns = 0;
+        while ((t = take_task(&deques[thread_id])) >= 0 ||
+               (t = steal_task(thread_id)) >= 0) {
+            Task *task = &task_queue[t];
+
+            if (opts.task_us > 0) clock_gettime(CLOCK_MONOTONIC, &t0);
+            rows_count += process_task(task, &rows_active);
+            if (opts.task_us > 0) {
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                part->busy_ns += elapsed_ns(&t0, &t1);
+                part->rows += task->end_row - task->start_row;
             }
-            /* Wait for more tasks or next iteration */
-            pthread_cond_wait(&task_cond, &task_mutex);
-        }
 
-        /* Check for program termination */
-        if (program_done) {
-            pthread_mutex_unlock(&task_mutex);
-            break;
-        }
-
-        /* Try to get a task */
-        got_task = 0;
-        if (next_task < num_tasks) {
-            task = task_queue[next_task++];
-            active_threads++;
-            got_task = 1;
-/*!!!
             if (DEBUG_LEVEL > 1) {
                 printf("Thread %d got task: rows %d-%d (size %d)\n",
-                       thread_id, task.start_row, task.end_row, task.chunk_size);
-            }*/
+                       thread_id, task->start_row, task->end_row, task->chunk_size);
+            }
         }
+        part->count = rows_count;
+        part->active = rows_active;
+        if (opts.task_us > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            part->finish_ns = elapsed_ns(&round_start, &t1);
+        }
+
+        /* Generation done */
+        barrier_wait(&barrier);
+    }
 
-        pthread_mutex_unlock(&task_mutex);
+    return NULL;
+}
 
-        /* Try to process task */
-        if (got_task) {
-            process_task(&task);
+/* Have the workers do one round of tasks of the given phase; returns the
+   population they counted, and *active the active tiles computed */
+long run_round(Phase p, int iteration, long *active) {
+    long count = 0;
 
-            /* Task is completed */
-            pthread_mutex_lock(&task_mutex);
-            active_threads--;
+    phase = p;
+    create_tasks(iteration);
+    if (opts.task_us > 0) clock_gettime(CLOCK_MONOTONIC, &round_start);
 
-            /* Done if all tasks are done */
-            if (next_task >= num_tasks && active_threads == 0) {
-                pthread_cond_signal(&done_cond);
-            }
+    /* Start the workers, then wait for them to finish the tasks */
+    barrier_wait(&barrier);
+    barrier_wait(&barrier);
 
-            pthread_mutex_unlock(&task_mutex);
-        }
+    *active = 0;
+    for (int i = 0; i < nthreads; i++) {
+        count += partials[i].count;
+        *active += partials[i].active;
     }
 
-    return NULL;
+    /* Feed the task times of an update into the next chunk sizes */
+    if (opts.task_us > 0 && p == PHASE_UPDATE) {
+        long rows = 0, busy = 0, first = partials[0].finish_ns, last = first;
+
+        for (int i = 0; i < nthreads; i++) {
+            rows += partials[i].rows;
+            busy += partials[i].busy_ns;
+            if (partials[i].finish_ns < first) first = partials[i].finish_ns;
+            if (partials[i].finish_ns > last) last = partials[i].finish_ns;
+        }
+        if (rows > 0 && busy > 0) {
+            double measured = (double)busy / rows;
+            row_ns = row_ns > 0 ? (row_ns + measured) / 2 : measured;
+        }
+        if (DEBUG_LEVEL > 0) {
+            printf("Iteration %d: %.1f ns per row, workers finished within %ld us\n",
+                   iteration, rows > 0 ? (double)busy / rows : 0.0, (last - first) / 1000);
+        }
+    }
+    return count;
 }
 
 int main(int argc, char *argv[]) {
-    int x, y;
     int iter = 0;
-    int c;
-    int init_count;
-    int count;
-    int nthreads = 4;  /* Default number of threads */
-
+    long init_count;
+    long count;
+    long active = 0;
+    unsigned engines = ENGINE_BIT(ENGINE_BYTE) | ENGINE_BIT(ENGINE_BITPACK) |
+                       ENGINE_BIT(ENGINE_SIMD) | ENGINE_BIT(ENGINE_LUT) |
+                       ENGINE_BIT(ENGINE_BOX);
+
+    if (life_parse_options(&argc, argv, &opts) != 0) exit(0);
+    if (opts.tune) exit(life_tune(opts.profile) != 0);
+    life_apply_profile(&opts, engines);
+    if (life_check_engine(&opts, engines) != 0) exit(0);
 
     if (argc == 1) {
-        printf("Usage: ./a.out w_X w_Y [num threads]\n");
+        printf("Usage: ./a.out w_X w_Y [num threads] [options]\n");
+        life_print_options();
         exit(0);
-    } else if (argc == 2) {
-        test_init();
-    } else /* more than three parameters */
-    {
-        init(atoi(argv[1]), atoi(argv[2]));
-
-        // Get number of threads if specified
-        if (argc >= 4) {
-            nthreads = atoi(argv[3]);
-            if (nthreads <= 0 || nthreads > MAX_THREADS) {
-                printf("Invalid number of threads (using default: 4)\n");
-                nthreads = 4;
-            }
-        }
     }
 
-    c = 0;
-    for (x=0; x<w_X; x++) {
-        for (y=0; y<w_Y; y++) {
-            if (w[y][x] == 1) c++;
+    // Get number of threads if specified
+    if (argc >= 4) {
+        nthreads = atoi(argv[3]);
+        if (nthreads <= 0 || nthreads > MAX_THREADS) {
+            printf("Invalid number of threads (using default: 4)\n");
+            nthreads = 4;
         }
     }
 
-    init_count = c;
-    count = init_count;
-
-    printf("Initial world, population count: %d, using %d threads\n", c, nthreads);
-    if (DEBUG_LEVEL > 10) print_world();
-
-    /* Create worker threads */
+    /* Create worker threads before the world, which they zero; the master
+       waits at the barrier with them */
+    barrier_init(&barrier, nthreads + 1);
     for (int i = 0; i < nthreads; i++) {
         thread_info[i].id = i;
         thread_info[i].nthreads = nthreads;
@@ -352,75 +592,87 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    for (iter = 0; iter < 200 && count < 50 * init_count && count > init_count / 50; iter++) {
-        /* Create tasks for this iteration */
-        pthread_mutex_lock(&task_mutex);
-        create_tasks(iter + 1);
-        current_iteration = iter + 1;
-        active_threads = 0;
-
-        /* Signal worker threads that tasks are available */
-        pthread_cond_broadcast(&task_cond);
-
-        /* Wait for all tasks to complete */
-        /* Timeout added to avoid some cases with deadlocks */
-        struct timespec timeout;
-        int all_done = 0;
-
-        while (!all_done) {
-            clock_gettime(CLOCK_REALTIME, &timeout);
-            timeout.tv_sec += 5;
-
-            /* Wait for done signal or timeout */
-            if (next_task >= num_tasks && active_threads == 0) {
-                /* All tasks are already done */
-                all_done = 1;
-            } else {
-                int wait_result = pthread_cond_timedwait(&done_cond, &task_mutex, &timeout);
-
-                if (wait_result == ETIMEDOUT) {
-                    printf("Warning: Timeout waiting for tasks to complete in iteration %d\n", iter);
-                    printf("  %d/%d tasks completed, %d threads active\n",
-                           next_task, num_tasks, active_threads);
-                    all_done = 1;
-                } else if (next_task >= num_tasks && active_threads == 0)
-                {
-                    all_done = 1;
-                }
-            }
+    if (argc == 2)
+        test_init();
+    else /* more than three parameters */
+        init(atoi(argv[1]), atoi(argv[2]));
+
+    {
+        int cpu[MAX_THREADS];
+
+        for (int i = 0; i < nthreads; i++) cpu[i] = thread_info[i].cpu;
+        life_print_placement("Worker", cpu, nthreads, opts.pin, DEBUG_LEVEL > 0);
+    }
+
+    /* The first round counts the initial population */
+    count = run_round(PHASE_COUNT, 0, &active);
+
+    init_count = count;
+
+    printf("Initial world, population count: %ld, using %d threads\n", count, nthreads);
+    if (DEBUG_LEVEL > 10) print_world();
+
+    if (opts.engine == ENGINE_SIMD) {
+        if (simd_init(opts.isa) != 0) exit(0);
+        printf("Using the %s vector kernel\n", simd_isa());
+    }
+
+    if (opts.engine == ENGINE_LUT) lut_init();
+
+    if (opts.engine == ENGINE_BITPACK) {
+        if (bitworld_alloc(&bw, w_X, w_Y) != 0) {
+            printf("Error: Failed to allocate memory for the bit-packed world\n");
+            exit(1);
         }
+        bitworld_load(&bw, GRID_ROW(w, 0), w->stride);
+    }
 
-        pthread_mutex_unlock(&task_mutex);
+    if (opts.active && active_alloc(&at, w_X, w_Y, opts.active) != 0) {
+        printf("Error: Failed to allocate memory for the active tiles\n");
+        exit(1);
+    }
 
-        /* copy the world, and count the current lives */
-        count = 0;
-        for (x=0; x<w_X; x++) {
-            for (y=0; y<w_Y; y++) {
-                w[y][x] = neww[y][x];
-                if (w[y][x] == 1) count++;
-            }
+    for (iter = 0; iter < 200 && count < 50 * init_count && count > init_count / 50; iter++) {
+        count = run_round(PHASE_UPDATE, iter + 1, &active);
+
+        /* Workers already counted the new generation, so it only has to
+           become the current one */
+        if (opts.engine == ENGINE_BITPACK) {
+            bitworld_swap(&bw);
+            if (DEBUG_LEVEL > 10) bitworld_store(&bw, GRID_ROW(w, 0), w->stride);
+        } else {
+            if (opts.active) active_swap(&at);
+            swap_grids();
         }
-        printf("iter = %d, population count = %d\n", iter, count);
+        if (opts.active)
+            printf("iter = %d, population count = %ld, active tiles = %ld of %ld\n",
+                   iter, count, active, active_total(&at));
+        else
+            printf("iter = %d, population count = %ld\n", iter, count);
         if (DEBUG_LEVEL > 10) print_world();
     }
 
     /* Signal threads to exit */
-    pthread_mutex_lock(&task_mutex);
     program_done = 1;
-    pthread_cond_broadcast(&task_cond);
-    pthread_mutex_unlock(&task_mutex);
+    barrier_wait(&barrier);
 
     /* Wait for all threads to exit */
     for (int i = 0; i < nthreads; i++) {
         pthread_join(thread_info[i].thread, NULL);
     }
 
+    if (opts.engine == ENGINE_BITPACK) {
+        bitworld_store(&bw, GRID_ROW(w, 0), w->stride);
+        bitworld_free(&bw);
+    }
+    if (opts.active) active_free(&at);
+
     if (NOOUTPUTFILE != 1) {
         FILE *fd;
         if ((fd = fopen("final_world000.txt", "w")) != NULL) {
             for (int x = 0; x < w_X; x++) {
                 for (int y = 0; y < w_Y; y++) {
-                    fprintf(fd, "%d", (int)w[y][x]);
+                    fprintf(fd, "%d", (int)CELL(w, y, x));
                 }
                 fprintf(fd, "\n");
             }
@@ -432,9 +684,7 @@ int main(int argc, char *argv[]) {
     }
 
     /* Clean up */
-    pthread_mutex_destroy(&task_mutex);
-    pthread_cond_destroy(&task_cond);
-    pthread_cond_destroy(&done_cond);
+    barrier_destroy(&barrier);
 
     return 0;
 }
\ No newline at end of file
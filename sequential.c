@@ -15,6 +15,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "life.h"
+
 
 
 #ifdef NOOUTPUTFILE
@@ -23,27 +25,65 @@
 #define NOOUTPUTFILE 0
 #endif
 
-#define MAX_N 8192
-
 #ifndef DEBUG_LEVEL
 #define DEBUG_LEVEL 0
 #endif
 
-char w[MAX_N][MAX_N];
-char neww[MAX_N][MAX_N];
+/* World plus its zero border, allocated by init(); index through CELL() */
+Grid grids[2];
+Grid *w = &grids[0];
+Grid *neww = &grids[1];
 
 int w_X, w_Y;
 
+/* Update engine; the sparse engine keeps its world in sw instead of the
+   grids */
+LifeOptions opts;
+SparseWorld sw;
+
+/* Allocate both grids once w_X and w_Y are known, and say which pages
+   they are on */
+void alloc_world()
+{
+  char pages[128];
+
+  if (opts.engine == ENGINE_SPARSE) {
+    if (sparse_alloc(&sw, w_X, w_Y) != 0) {
+      printf("Error: Failed to allocate memory for a %d x %d world\n", w_X, w_Y);
+      exit(1);
+    }
+    return;
+  }
+  if (grid_alloc(w, w_X, w_Y) != 0 || grid_alloc(neww, w_X, w_Y) != 0) {
+    printf("Error: Failed to allocate memory for a %d x %d world\n", w_X, w_Y);
+    exit(1);
+  }
+  if (grid_describe_pages(w, pages, sizeof(pages)) == 0) printf("World grids on %s\n", pages);
+}
+
+/* Make cell (x, y) alive in whichever form the world is kept */
+void set_alive(int y, int x)
+{
+  if (opts.engine != ENGINE_SPARSE)
+    CELL(w, y, x) = 1;
+  else if (sparse_add(&sw, x, y) != 0) {
+    printf("Error: Failed to allocate memory for the live cells\n");
+    exit(1);
+  }
+}
+
 void init(int X, int Y)
 {
   int i, j;
   w_X = X,  w_Y = Y;
-  for (i=0; i<w_X;i++)
-    for (j=0; j<w_Y; j++)
-      w[j][i] = 0;
+  alloc_world();
+  if (opts.engine != ENGINE_SPARSE)
+    for (i=0; i<w_X;i++)
+      for (j=0; j<w_Y; j++)
+        CELL(w, j, i) = 0;
 
-  for (i=0; i<w_X && i < w_Y; i++) w[i][i] = 1;
-  for (i=0; i<w_Y && i < w_X; i++) w[w_Y - 1 - i][i] = 1;
+  for (i=0; i<w_X && i < w_Y; i++) set_alive(i, i);
+  for (i=0; i<w_Y && i < w_X; i++) set_alive(w_Y - 1 - i, i);
 }
 
 void test_init()
@@ -52,14 +92,16 @@ void test_init()
   int i, j;
   w_X = 4;
   w_Y = 6;
+  alloc_world();
 
-  for (i=0; i<w_X;i++)
-    for (j=0; j<w_Y; j++)
-      w[j][i] = 0;
-  w[0][3] = 1;
-  w[1][3] = 1;
-  w[2][1] = 1;
-  w[3][0] = w[3][1] = w[3][2] = w[4][1] = w[5][1] = 1;
+  if (opts.engine != ENGINE_SPARSE)
+    for (i=0; i<w_X;i++)
+      for (j=0; j<w_Y; j++)
+        CELL(w, j, i) = 0;
+  set_alive(0, 3);
+  set_alive(1, 3);
+  set_alive(2, 1);
+  set_alive(3, 0); set_alive(3, 1); set_alive(3, 2); set_alive(4, 1); set_alive(5, 1);
 }
 
 void print_world()
@@ -68,7 +110,8 @@ void print_world()
 
   for (i=0; i<w_Y; i++) {
     for (j=0; j<w_X; j++) {
-      printf("%d", (int)w[i][j]);
+      if (opts.engine == ENGINE_SPARSE) printf("%d", sparse_get(&sw, j, i));
+      else printf("%d", (int)CELL(w, i, j));
     }
     printf("\n");
   }
@@ -76,47 +119,26 @@ void print_world()
 
 int neighborcount(int x, int y)
 {
-  int count = 0;
-
-  if ((x<0) || (x >=w_X)) {
-    printf("neighborcount: (%d %d) out of bound (0..%d, 0..%d).\n", x,y,
-	   w_X, w_Y);
-    exit(0);
-  }
-  if ((y<0) || (y >=w_Y)) {
-    printf("neighborcount: (%d %d) out of bound (0..%d, 0..%d).\n", x,y,
-	   w_X, w_Y);
-    exit(0);
-  }
+  /* The zero border gives every cell, edges and corners included, the
+     same eight neighbors */
+  return CELL(w, y-1, x-1) + CELL(w, y-1, x) + CELL(w, y-1, x+1)
+         + CELL(w, y, x-1) + CELL(w, y, x+1)
+         + CELL(w, y+1, x-1) + CELL(w, y+1, x) + CELL(w, y+1, x+1);
+}
 
-  if (x==0) {
-    if (y == 0) {
-      count = w[y][x+1] + w[y+1][x] + w[y+1][x+1];
-    } else if (y == w_Y-1) {
-      count = w[y][x+1] + w[y-1][x] + w[y-1][x+1];
-    } else {
-      count = w[y-1][x] + w[y+1][x] + w[y-1][x+1] + w[y][x+1] + w[y+1][x+1];
-    }
-  } else if (x == w_X -1) {
-    if (y == 0) {
-      count = w[y][x-1] + w[y+1][x-1] + w[y+1][x];
-    } else if (y == w_Y-1) {
-      count = w[y][x-1] + w[y-1][x] + w[y-1][x-1];
-    } else {
-      count = w[y-1][x] + w[y+1][x] + w[y-1][x-1] + w[y][x-1] + w[y+1][x-1];
-    }
-  } else { /* x is in the middle */
-    if (y == 0) {
-      count = w[y][x-1] + w[y][x+1] + w[y+1][x-1] + w[y+1][x] + w[y+1][x+1];
-    } else if (y == w_Y-1) {
-      count = w[y][x-1] + w[y][x+1] + w[y-1][x-1] + w[y-1][x] + w[y-1][x+1];
-    } else {
-      count = w[y-1][x-1] + w[y][x-1] + w[y+1][x-1] + w[y-1][x] + w[y+1][x]
-              + w[y-1][x+1] + w[y][x+1] + w[y+1][x+1];
-    }
-  }
+/* Make the generation just computed in neww the current one */
+void swap_grids()
+{
+  Grid *t = w;
+  w = neww;
+  neww = t;
+}
 
-  return count;
+/* Next state of row y with the vector kernel, returns its population */
+long simd_update_row(int y)
+{
+  return simd_row(GRID_ROW(neww, y), GRID_ROW(w, y-1), GRID_ROW(w, y),
+                  GRID_ROW(w, y+1), w_X);
 }
 
 int main(int argc, char *argv[])
@@ -124,69 +146,204 @@ int main(int argc, char *argv[])
   int x, y;
   int iter = 0;
   int c;
-  int init_count;
-  int count;
+  long init_count;
+  long count;
+  BitWorld bw;
+  long block_counts[TILED_MAX_STEPS];
+  ActiveTiles at;
+  long active = 0;
+  int block_len = 0, block_pos = 0;
+  unsigned engines = ENGINE_BIT(ENGINE_BYTE) | ENGINE_BIT(ENGINE_BITPACK) |
+                     ENGINE_BIT(ENGINE_SIMD) | ENGINE_BIT(ENGINE_TILED) |
+                     ENGINE_BIT(ENGINE_HASHLIFE) | ENGINE_BIT(ENGINE_SPARSE) |
+                     ENGINE_BIT(ENGINE_LUT) | ENGINE_BIT(ENGINE_BOX);
+
+  if (life_parse_options(&argc, argv, &opts) != 0) exit(0);
+  if (opts.tune) exit(life_tune(opts.profile) != 0);
+  life_apply_profile(&opts, engines);
+  if (life_check_engine(&opts, engines) != 0) exit(0);
 
   if (argc == 1) {
-    printf("Usage: ./a.out w_X w_Y\n");
+    printf("Usage: ./a.out w_X w_Y [options]\n");
+    life_print_options();
     exit(0);
   } else if (argc == 2)
     test_init();
   else /* more than three parameters */
     init(atoi(argv[1]), atoi(argv[2]));
 
-  c = 0;
-  for (x=0; x<w_X; x++) {
-    for (y=0; y<w_Y; y++) {
-      if (w[y][x] == 1) c++;
+  count = 0;
+  if (opts.engine == ENGINE_SPARSE)
+    count = sparse_count(&sw);
+  else
+    for (x=0; x<w_X; x++) {
+      for (y=0; y<w_Y; y++) {
+        if (CELL(w, y, x) == 1) count++;
+      }
+    }
+
+  init_count = count;
+
+  printf("initial world, population count: %ld\n", count);
+  if (DEBUG_LEVEL > 10) print_world();
+
+  if (opts.engine == ENGINE_SIMD || opts.engine == ENGINE_TILED) {
+    if (simd_init(opts.isa) != 0) exit(0);
+    printf("Using the %s vector kernel\n", simd_isa());
+  }
+
+  if (opts.engine == ENGINE_LUT) lut_init();
+
+  /* Printing every generation needs the world after every generation */
+  if (opts.engine == ENGINE_TILED && DEBUG_LEVEL > 10) opts.tsteps = 1;
+
+  if (opts.engine == ENGINE_BITPACK) {
+    if (bitworld_alloc(&bw, w_X, w_Y) != 0) {
+      printf("Error: Failed to allocate memory for the bit-packed world\n");
+      exit(1);
     }
+    bitworld_load(&bw, GRID_ROW(w, 0), w->stride);
   }
 
-  init_count = c;
-  count = init_count;
+  if (opts.active && active_alloc(&at, w_X, w_Y, opts.active) != 0) {
+    printf("Error: Failed to allocate memory for the active tiles\n");
+    exit(1);
+  }
 
-  printf("initial world, population count: %d\n", c);
-  if (DEBUG_LEVEL > 10) print_world();
+  if (opts.engine == ENGINE_HASHLIFE) {
+    if (hashlife_load(w, (size_t)opts.hl_mem << 20) != 0) {
+      printf("Error: The world is too big for the hashlife engine\n");
+      exit(1);
+    }
+    if (opts.hl_step > hashlife_max_step()) opts.hl_step = hashlife_max_step();
+  }
 
   for (iter = 0; (iter < 200) && (count <50*init_count) &&
 	 (count > init_count / 50); iter ++) {
 
-    for (x=0; x < w_X; x++) {
-      for (y=0; y<w_Y; y++) {
-        c = neighborcount(x, y);  /* count neighbors */
-        if (c <= 1) neww[y][x] = 0;      /* die of loneliness */
-        else if (c >=4) neww[y][x] = 0;  /* die of overpopulation */
-        else if (c == 3)  neww[y][x] = 1;             /* becomes alive */
-	else neww[y][x] = w[y][x];   /* c == 2, no change */
+    if (opts.engine == ENGINE_BITPACK) {
+      count = bitworld_step(&bw, 0, w_Y);
+      bitworld_swap(&bw);
+      if (DEBUG_LEVEL > 10) bitworld_store(&bw, GRID_ROW(w, 0), w->stride);
+    } else if (opts.engine == ENGINE_TILED) {
+      /* Each pass runs a block of generations into w (the block's start
+         stays in neww); their counts are then handed out one per iteration */
+      if (block_pos == block_len) {
+        block_len = opts.tsteps < 200 - iter ? opts.tsteps : 200 - iter;
+        block_pos = 0;
+        if (tiled_step(neww, w, block_len, opts.tile_w, opts.tile_h,
+                       block_counts) != 0) {
+          printf("Error: Failed to allocate memory for the tiles\n");
+          exit(1);
+        }
+        swap_grids();
       }
-    }
-
-    /* copy the world, and count the current lives */
-    count = 0;
-    for (x=0; x<w_X; x++) {
-      for (y=0; y<w_Y; y++) {
-	w[y][x] = neww[y][x];
-	if (w[y][x] == 1) count++;
+      count = block_counts[block_pos++];
+    } else if (opts.engine == ENGINE_SPARSE) {
+      count = sparse_step(&sw);
+      if (count < 0) {
+        printf("Error: Failed to allocate memory for the live cells\n");
+        exit(1);
+      }
+    } else if (opts.engine == ENGINE_HASHLIFE) {
+      /* Jump 2^j generations, not past generation 200; the stop rule is
+         only seen at the end of a jump, so when it trips there the jump
+         is done again one generation at a time, and from then on too. A
+         population that leaves the bounds and comes back within one jump
+         is missed: stopping is only exact with --hl-step=0. */
+      int j = opts.hl_step;
+      while (j > 0 && (1 << j) > 200 - iter) j--;
+      hashlife_checkpoint();
+      count = hashlife_step(j);
+      if (j > 0 && !(count < 50*init_count && count > init_count / 50)) {
+        hashlife_rollback();
+        opts.hl_step = j = 0;
+        count = hashlife_step(0);
       }
+      iter += (1 << j) - 1;
+      if (DEBUG_LEVEL > 10) hashlife_store(w);
+    } else {
+      /* Walk along the rows, which are contiguous, and count the new
+         generation while writing it */
+      count = 0;
+      if (opts.active) {
+        /* Only the tiles around last generation's changes */
+        active = 0;
+        count = active_step(&at, neww, w, opts.engine == ENGINE_SIMD ? simd_row : scalar_row,
+                            0, w_Y, &active);
+        active_swap(&at);
+      } else if (opts.engine == ENGINE_SIMD) {
+        for (y=0; y<w_Y; y++) count += simd_update_row(y);
+      } else if (opts.engine == ENGINE_LUT) {
+        count = lut_band(neww, w, 0, w_Y);
+      } else if (opts.engine == ENGINE_BOX) {
+        count = box_band(neww, w, 0, w_Y);
+      } else {
+        for (y=0; y<w_Y; y++) {
+          for (x=0; x < w_X; x++) {
+            c = neighborcount(x, y);  /* count neighbors */
+            if (c <= 1) CELL(neww, y, x) = 0;      /* die of loneliness */
+            else if (c >=4) CELL(neww, y, x) = 0;  /* die of overpopulation */
+            else if (c == 3)  CELL(neww, y, x) = 1;             /* becomes alive */
+            else CELL(neww, y, x) = CELL(w, y, x);   /* c == 2, no change */
+            count += CELL(neww, y, x);
+          }
+        }
+      }
+
+      /* The new generation becomes the current one, no copy needed */
+      swap_grids();
     }
-    printf("iter = %d, population count = %d\n", iter, count);
+    if (opts.active)
+      printf("iter = %d, population count = %ld, active tiles = %ld of %ld\n",
+             iter, count, active, active_total(&at));
+    else
+      printf("iter = %d, population count = %ld\n", iter, count);
     if (DEBUG_LEVEL > 10) print_world();
   }
 
+  if (opts.engine == ENGINE_BITPACK) {
+    bitworld_store(&bw, GRID_ROW(w, 0), w->stride);
+    bitworld_free(&bw);
+  }
+
+  if (opts.engine == ENGINE_HASHLIFE) {
+    if (DEBUG_LEVEL > 0) printf("hashlife: %zu nodes cached\n", hashlife_nodes());
+    hashlife_store(w);
+    hashlife_free();
+  }
+
+  if (opts.active) active_free(&at);
+
+  /* Stopped part way through a block: w ran ahead, so redo the block from
+     its start only up to the generation that was reached */
+  if (opts.engine == ENGINE_TILED && block_pos < block_len) {
+    if (tiled_step(w, neww, block_pos, opts.tile_w, opts.tile_h,
+                     block_counts) != 0) {
+      printf("Error: Failed to allocate memory for the tiles\n");
+      exit(1);
+    }
+  }
+
   if (NOOUTPUTFILE != 1)
   {
     FILE *fd;
     if ((fd = fopen("final_world000.txt", "w")) != NULL) {
-      for (x=0; x<w_X; x++) {
-	for (y=0; y<w_Y; y++) {
-          fprintf(fd, "%d", (int)w[y][x]);
-	}
-	fprintf(fd, "\n");
+      if (opts.engine == ENGINE_SPARSE) {
+        sparse_write(&sw, fd);
+      } else {
+        for (x=0; x<w_X; x++) {
+          for (y=0; y<w_Y; y++) {
+            fprintf(fd, "%d", (int)CELL(w, y, x));
+          }
+          fprintf(fd, "\n");
+        }
       }
     } else {
       printf("Can't open file final_world000.txt\n");
       exit(1);
     }
   }
+  if (opts.engine == ENGINE_SPARSE) sparse_free(&sw);
   return 0;
 }
\ No newline at end of file